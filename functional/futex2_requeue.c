@@ -0,0 +1,265 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      futex2_requeue.c
+ *
+ * DESCRIPTION
+ *      Requeue waiters between two futex2 words of the sizes selected with
+ *      -f and -t using futex2_requeue(). Check that it fails with EAGAIN
+ *      when the source holds an unexpected value, that it moves every
+ *      waiter without waking any when nr_wake is 0, and that moving them
+ *      back with nr_wake and nr_requeue of 1 wakes and requeues exactly one
+ *      each. Word sizes the kernel does not implement must be rejected with
+ *      EINVAL.
+ *
+ *****************************************************************************/
+
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "atomic.h"
+#include "futextest.h"
+#include "logging.h"
+
+#define MAX_WAKE_ITERS 1000
+#define THREAD_MAX 64
+
+static const char *words[] = { "u8", "u16", "u32", "u64" };
+
+static int threads = 4;
+static unsigned int src_flags = FUTEX2_SIZE_U32 | FUTEX2_PRIVATE;
+static unsigned int dst_flags = FUTEX2_SIZE_U64 | FUTEX2_PRIVATE;
+
+/* Wide and aligned enough for every word size */
+static futex64_t src_word __attribute__((aligned(8)));
+static futex64_t dst_word __attribute__((aligned(8)));
+
+static atomic_t woken = ATOMIC_INITIALIZER;
+static atomic_t errors = ATOMIC_INITIALIZER;
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -c	Use color\n");
+	printf("  -f Z	Source word: u8, u16, u32 or u64 (default: u32)\n");
+	printf("  -h	Display this help message\n");
+	printf("  -n N	Number of waiters, 3 to %d (default: %d)\n",
+	       THREAD_MAX, threads);
+	printf("  -t Z	Target word: u8, u16, u32 or u64 (default: u64)\n");
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+}
+
+static int parse_word(const char *arg, unsigned int *flags)
+{
+	int size;
+
+	for (size = 0; size < 4; size++)
+		if (!strcmp(arg, words[size])) {
+			*flags = size | FUTEX2_PRIVATE;
+			return 0;
+		}
+	return -1;
+}
+
+/* Fails with EINVAL if the kernel lacks this word size */
+static int word_supported(volatile void *uaddr, unsigned int flags)
+{
+	return futex2_wake(uaddr, futex2_mask(flags), 1, flags) >= 0;
+}
+
+static void *waiter_thread(void *arg)
+{
+	if (futex2_wait(&src_word, 0, futex2_mask(src_flags), src_flags, NULL,
+			CLOCK_MONOTONIC)) {
+		error("futex2_wait\n", errno);
+		atomic_inc(&errors);
+	}
+	atomic_inc(&woken);
+	return NULL;
+}
+
+/* Wait up to MAX_WAKE_ITERS ms for woken to reach count */
+static int wait_woken(int count)
+{
+	int i;
+
+	for (i = 0; woken.val < count && i < MAX_WAKE_ITERS; i++)
+		usleep(1000);
+	return woken.val == count;
+}
+
+int main(int argc, char *argv[])
+{
+	struct futex_waitv forth[2], back[2];
+	pthread_t thread[THREAD_MAX];
+	int res, ret = RET_PASS;
+	int i, c, moved;
+
+	while ((c = getopt(argc, argv, "cf:hn:t:v:")) != -1) {
+		switch(c) {
+		case 'c':
+			log_color(1);
+			break;
+		case 'f':
+			if (parse_word(optarg, &src_flags)) {
+				usage(basename(argv[0]));
+				exit(1);
+			}
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'n':
+			threads = atoi(optarg);
+			break;
+		case 't':
+			if (parse_word(optarg, &dst_flags)) {
+				usage(basename(argv[0]));
+				exit(1);
+			}
+			break;
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	printf("%s: Requeue between futex2 words of two sizes\n",
+	       basename(argv[0]));
+	printf("\tArguments: from=%s to=%s waiters=%d\n",
+	       words[src_flags & FUTEX2_SIZE_MASK],
+	       words[dst_flags & FUTEX2_SIZE_MASK], threads);
+
+	if (threads < 3 || threads > THREAD_MAX) {
+		error("waiters must be between 3 and %d\n", 0, THREAD_MAX);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+	futex2_waitv_set(&forth[0], &src_word, 0, src_flags);
+	futex2_waitv_set(&forth[1], &dst_word, 0, dst_flags);
+	futex2_waitv_set(&back[0], &dst_word, 0, dst_flags);
+	futex2_waitv_set(&back[1], &src_word, 0, src_flags);
+
+	if (!word_supported(&src_word, src_flags) ||
+	    !word_supported(&dst_word, dst_flags)) {
+		if (errno == ENOSYS) {
+			error("futex2_wake\n", errno);
+			print_result(RET_ERROR);
+			return RET_ERROR;
+		}
+		info("The kernel lacks one of the word sizes, expecting EINVAL\n");
+		res = futex2_requeue(forth, 0, 1);
+		if (res >= 0 || errno != EINVAL) {
+			fail("futex2_requeue returned %d, expected EINVAL\n",
+			     res < 0 ? errno : res);
+			ret = RET_FAIL;
+		}
+		print_result(ret);
+		return ret;
+	}
+
+	info("Calling futex2_requeue with an unexpected source value\n");
+	forth[0].val = 1;
+	res = futex2_requeue(forth, 0, 1);
+	forth[0].val = 0;
+	if (res >= 0 || errno != EAGAIN) {
+		fail("futex2_requeue returned %d, expected EAGAIN\n",
+		     res < 0 ? errno : res);
+		ret = RET_FAIL;
+	}
+
+	for (i = 0; i < threads; i++) {
+		if ((res = pthread_create(&thread[i], NULL, waiter_thread,
+					  NULL))) {
+			error("pthread_create\n", res);
+			/* Waiters on the words go away with the process */
+			print_result(RET_ERROR);
+			return RET_ERROR;
+		}
+	}
+
+	info("Requeueing %d waiters to the %s word without waking any\n",
+	     threads, words[dst_flags & FUTEX2_SIZE_MASK]);
+	/* Retry until every waiter has blocked and been moved */
+	for (moved = i = 0; moved < threads && i < MAX_WAKE_ITERS; i++) {
+		res = futex2_requeue(forth, 0, INT_MAX);
+		if (res < 0) {
+			error("futex2_requeue\n", errno);
+			print_result(RET_ERROR);
+			return RET_ERROR;
+		}
+		moved += res;
+		if (moved < threads)
+			usleep(1000);
+	}
+	if (moved != threads || woken.val) {
+		fail("requeued %d waiters and woke %d, expected %d and 0\n",
+		     moved, woken.val, threads);
+		ret = RET_FAIL;
+	}
+
+	info("Requeueing back with nr_wake=1 nr_requeue=1\n");
+	res = futex2_requeue(back, 1, 1);
+	if (res != 2) {
+		fail("futex2_requeue returned %d, expected 2\n",
+		     res < 0 ? -errno : res);
+		ret = RET_FAIL;
+	}
+	if (!wait_woken(1)) {
+		fail("%d waiters woke, expected 1\n", woken.val);
+		ret = RET_FAIL;
+	}
+
+	info("Waking the waiters left on both words\n");
+	res = futex2_wake(&src_word, futex2_mask(src_flags), INT_MAX,
+			  src_flags);
+	if (res != 1) {
+		fail("futex2_wake of the %s word returned %d, expected 1\n",
+		     words[src_flags & FUTEX2_SIZE_MASK],
+		     res < 0 ? -errno : res);
+		ret = RET_FAIL;
+	}
+	res = futex2_wake(&dst_word, futex2_mask(dst_flags), INT_MAX,
+			  dst_flags);
+	if (res != threads - 2) {
+		fail("futex2_wake of the %s word returned %d, expected %d\n",
+		     words[dst_flags & FUTEX2_SIZE_MASK],
+		     res < 0 ? -errno : res, threads - 2);
+		ret = RET_FAIL;
+	}
+	if (!wait_woken(threads)) {
+		/* Waiters on the words go away with the process */
+		fail("%d of %d waiters woke\n", woken.val, threads);
+		print_result(RET_FAIL);
+		return RET_FAIL;
+	}
+	for (i = 0; i < threads; i++)
+		pthread_join(thread[i], NULL);
+	if (errors.val)
+		ret = RET_ERROR;
+
+	print_result(ret);
+	return ret;
+}
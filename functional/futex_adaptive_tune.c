@@ -0,0 +1,139 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      futex_adaptive_tune.c
+ *
+ * DESCRIPTION
+ *      Check that the self tuned spin budget of the futex_adaptive mutex
+ *      decays when the mutex is held far longer than any spin. Starting
+ *      from half of FUTEX_SPIN_MAX, threads take the mutex and sleep while
+ *      holding it, so waiters run out of budget and block, and the budget
+ *      must end up small instead of ratcheting up.
+ *
+ *****************************************************************************/
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "futextest.h"
+#include "futex_mutex.h"
+#include "logging.h"
+
+/* Largest tuned average accepted once the budget has decayed */
+#define SMALL_SPINS 64
+
+static int threads = 4;
+static int iterations = 100;
+static int hold_us = 200;
+
+static futex_t mutex = FUTEX_INITIALIZER;
+static futex_t tune __attribute__((aligned(64))) = FUTEX_SPIN_MAX / 2;
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -c	Use color\n");
+	printf("  -h	Display this help message\n");
+	printf("  -i I	Acquisitions per thread (default: %d)\n", iterations);
+	printf("  -n N	Number of threads (default: %d)\n", threads);
+	printf("  -s S	Hold time in microseconds (default: %d)\n", hold_us);
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+}
+
+static void *locker_thread(void *arg)
+{
+	int i;
+
+	for (i = 0; i < iterations; i++) {
+		futex_adaptive_lock(&mutex, &tune, -1, FUTEX_PRIVATE_FLAG);
+		usleep(hold_us);
+		futex_adaptive_unlock(&mutex, FUTEX_PRIVATE_FLAG);
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t *thread;
+	int ret = RET_PASS;
+	int i, c, res;
+
+	while ((c = getopt(argc, argv, "chi:n:s:v:")) != -1) {
+		switch(c) {
+		case 'c':
+			log_color(1);
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		case 'n':
+			threads = atoi(optarg);
+			break;
+		case 's':
+			hold_us = atoi(optarg);
+			break;
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	printf("%s: Check the adaptive spin budget decays under long holds\n",
+	       basename(argv[0]));
+	printf("\tArguments: threads=%d iterations=%d hold=%dus\n", threads,
+	       iterations, hold_us);
+
+	thread = calloc(threads, sizeof(*thread));
+	if (!thread) {
+		error("calloc\n", errno);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+	info("Starting with a budget average of %u\n", tune);
+	for (i = 0; i < threads; i++) {
+		if ((res = pthread_create(thread + i, NULL, locker_thread,
+					  NULL))) {
+			error("pthread_create\n", res);
+			/* The started threads go away with the process */
+			print_result(RET_ERROR);
+			return RET_ERROR;
+		}
+	}
+	for (i = 0; i < threads; i++)
+		pthread_join(thread[i], NULL);
+	free(thread);
+
+	info("Ended with a budget average of %u\n", tune);
+	if (tune > SMALL_SPINS) {
+		fail("budget average is %u after long holds, expected at most "
+		     "%d\n", tune, SMALL_SPINS);
+		ret = RET_FAIL;
+	}
+
+	print_result(ret);
+	return ret;
+}
@@ -43,6 +43,7 @@
 #include "atomic.h"
 #include "futextest.h"
 #include "logging.h"
+#include "rt_thread.h"
 
 #define MAX_WAKE_ITERS 1000
 #define THREAD_MAX 10
@@ -82,38 +83,6 @@ void usage(char *prog)
 	       VQUIET, VCRITICAL, VINFO);
 }
 
-int create_rt_thread(pthread_t *pth, void*(*func)(void*), void *arg, int policy, int prio)
-{
-	int ret;
-	struct sched_param schedp;
-	pthread_attr_t attr;
-	
-	pthread_attr_init(&attr);
-	memset(&schedp, 0, sizeof(schedp));
-
-	if ((ret = pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED)) != 0) {
-		error("pthread_attr_setinheritsched\n", ret);
-		return -1;
-	}
-
-	if ((ret = pthread_attr_setschedpolicy(&attr, policy)) != 0) {
-		error("pthread_attr_setschedpolicy\n", ret);
-		return -1;
-	}
-
-	schedp.sched_priority = prio;
-	if ((ret = pthread_attr_setschedparam(&attr, &schedp)) != 0) {
-		error("pthread_attr_setschedparam\n", ret);
-		return -1;
-	}
-
-	if ((ret = pthread_create(pth, &attr, func, arg)) != 0) {
-		error("pthread_create\n", ret);
-		return -1;
-	}
-	return 0;
-}
-
 
 void *waiterfn(void *arg)
 {
@@ -0,0 +1,169 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      futex_waitv.c
+ *
+ * DESCRIPTION
+ *      Block on several futexes at once with futex_waitv(). Check that it
+ *      fails with EAGAIN when any one futex holds an unexpected value, with
+ *      ETIMEDOUT when nothing wakes it, with EINVAL for an empty or oversized
+ *      array, and that a FUTEX_WAKE on any one futex returns its index.
+ *
+ *****************************************************************************/
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "futextest.h"
+#include "logging.h"
+
+#define timeout_ns 100000
+
+static int nr_futexes = FUTEX_WAITV_MAX;
+
+static futex_t futexes[FUTEX_WAITV_MAX];
+static struct futex_waitv waiters[FUTEX_WAITV_MAX + 1];
+static volatile int woken_index = -2;
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -c	Use color\n");
+	printf("  -h	Display this help message\n");
+	printf("  -n N	Number of futexes, up to %d (default: %d)\n",
+	       FUTEX_WAITV_MAX, nr_futexes);
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+}
+
+static void *waiter_thread(void *arg)
+{
+	int res;
+
+	res = futex_waitv(waiters, nr_futexes, NULL, CLOCK_MONOTONIC);
+	woken_index = res < 0 ? -errno : res;
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct timespec to;
+	pthread_t thread;
+	int res, ret = RET_PASS;
+	int i, c, target;
+
+	while ((c = getopt(argc, argv, "chn:v:")) != -1) {
+		switch(c) {
+		case 'c':
+			log_color(1);
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'n':
+			nr_futexes = atoi(optarg);
+			break;
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	printf("%s: Block on several futexes with futex_waitv\n",
+	       basename(argv[0]));
+	printf("\tArguments: futexes=%d\n", nr_futexes);
+
+	if (nr_futexes < 1 || nr_futexes > FUTEX_WAITV_MAX) {
+		error("futexes must be between 1 and %d\n", 0, FUTEX_WAITV_MAX);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+	for (i = 0; i < nr_futexes; i++)
+		futex_waitv_set(&waiters[i], &futexes[i], 0, FUTEX_PRIVATE_FLAG);
+
+	info("Calling futex_waitv with an unexpected value in the last futex\n");
+	futexes[nr_futexes - 1] = 1;
+	res = futex_waitv(waiters, nr_futexes, NULL, CLOCK_MONOTONIC);
+	futexes[nr_futexes - 1] = 0;
+	if (res < 0 && errno == ENOSYS) {
+		error("futex_waitv\n", errno);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+	if (res >= 0 || errno != EAGAIN) {
+		fail("futex_waitv returned %d, expected EAGAIN\n",
+		     res < 0 ? errno : res);
+		ret = RET_FAIL;
+	}
+
+	info("Calling futex_waitv with a %dns timeout\n", timeout_ns);
+	clock_gettime(CLOCK_MONOTONIC, &to);
+	to.tv_nsec += timeout_ns;
+	if (to.tv_nsec >= 1000000000) {
+		to.tv_sec++;
+		to.tv_nsec -= 1000000000;
+	}
+	res = futex_waitv(waiters, nr_futexes, &to, CLOCK_MONOTONIC);
+	if (res >= 0 || errno != ETIMEDOUT) {
+		fail("futex_waitv returned %d, expected ETIMEDOUT\n",
+		     res < 0 ? errno : res);
+		ret = RET_FAIL;
+	}
+
+	info("Calling futex_waitv with 0 and %d futexes\n",
+	     FUTEX_WAITV_MAX + 1);
+	res = futex_waitv(waiters, 0, NULL, CLOCK_MONOTONIC);
+	if (res >= 0 || errno != EINVAL) {
+		fail("futex_waitv of 0 futexes returned %d, expected EINVAL\n",
+		     res < 0 ? errno : res);
+		ret = RET_FAIL;
+	}
+	res = futex_waitv(waiters, FUTEX_WAITV_MAX + 1, NULL, CLOCK_MONOTONIC);
+	if (res >= 0 || errno != EINVAL) {
+		fail("futex_waitv of %d futexes returned %d, expected EINVAL\n",
+		     FUTEX_WAITV_MAX + 1, res < 0 ? errno : res);
+		ret = RET_FAIL;
+	}
+
+	target = nr_futexes / 2;
+	info("Waking futex %d of %d\n", target, nr_futexes);
+	if ((res = pthread_create(&thread, NULL, waiter_thread, NULL))) {
+		error("pthread_create\n", res);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+	/* Retry until the waiter has blocked and the wake finds it */
+	while (futex_wake(&futexes[target], 1, FUTEX_PRIVATE_FLAG) < 1 &&
+	       woken_index == -2)
+		usleep(1000);
+	pthread_join(thread, NULL);
+	if (woken_index != target) {
+		fail("futex_waitv returned %d, expected %d\n", woken_index,
+		     target);
+		ret = RET_FAIL;
+	}
+
+	print_result(ret);
+	return ret;
+}
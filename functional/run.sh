@@ -90,3 +90,12 @@ echo
 ./futex_wait_uninitialized_heap $COLOR
 ./futex_wait_private_mapped_file $COLOR
 
+echo
+./futex_waitv $COLOR
+
+echo
+./futex_adaptive_tune $COLOR
+
+echo
+./futex2_requeue $COLOR
+./futex2_requeue $COLOR -f u32 -t u32
@@ -0,0 +1,182 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      futex_barrier.h
+ *
+ * DESCRIPTION
+ *      Example reusable tree barrier between N participants and a master.
+ *      The participants form a tree of fan out FUTEX_BARRIER_FANOUT, each
+ *      with its own cache line aligned node. A participant waits on its node
+ *      for its children to arrive, then reports to its parent, the root
+ *      reporting to the master. The master releases the root, and every
+ *      participant releases its children in turn, so no futex is ever
+ *      contended by more than FUTEX_BARRIER_FANOUT tasks and no single
+ *      FUTEX_WAKE has to walk every waiter.
+ *
+ *****************************************************************************/
+
+#ifndef _FUTEX_BARRIER_H
+#define _FUTEX_BARRIER_H
+
+#include "futextest.h"
+
+#define FUTEX_BARRIER_FANOUT	4
+
+struct futex_barrier_node {
+	futex_t arrived;	/* children arrived, counted over all rounds */
+	futex_t release;	/* last round released */
+	u_int32_t round;	/* rounds entered, only touched by the owner */
+} __attribute__((aligned(64)));
+
+struct futex_barrier {
+	futex_t arrived;	/* rounds the root arrived for */
+	u_int32_t round;	/* rounds the master waited for */
+	volatile int value;	/* returned by futex_barrier_sync() */
+	volatile int abort;
+	int threads;
+	struct futex_barrier_node *nodes;
+};
+
+/**
+ * futex_barrier_init() - set up a barrier
+ * @nodes:	one node per participant, in shared memory for a barrier
+ *		shared between processes
+ * @threads:	the number of participants
+ */
+static inline void futex_barrier_init(struct futex_barrier *b,
+				      struct futex_barrier_node *nodes,
+				      int threads)
+{
+	int i;
+
+	b->arrived = 0;
+	b->round = 0;
+	b->value = 0;
+	b->abort = 0;
+	b->threads = threads;
+	b->nodes = nodes;
+	for (i = 0; i < threads; i++) {
+		nodes[i].arrived = 0;
+		nodes[i].release = 0;
+		nodes[i].round = 0;
+	}
+}
+
+static inline u_int32_t futex_barrier_children(struct futex_barrier *b, int id)
+{
+	int first = id * FUTEX_BARRIER_FANOUT + 1;
+
+	if (first >= b->threads)
+		return 0;
+	if (b->threads - first < FUTEX_BARRIER_FANOUT)
+		return b->threads - first;
+	return FUTEX_BARRIER_FANOUT;
+}
+
+/**
+ * futex_barrier_sync() - arrive at the barrier and wait to be released
+ * @id:		the caller's participant number, from 0 to threads - 1
+ *
+ * Return the value passed to futex_barrier_release() or
+ * futex_barrier_abort().
+ */
+static inline int futex_barrier_sync(struct futex_barrier *b, int id,
+				     int opflags)
+{
+	struct futex_barrier_node *node = &b->nodes[id];
+	struct futex_barrier_node *parent;
+	u_int32_t round = ++node->round;
+	u_int32_t want = round * futex_barrier_children(b, id);
+	u_int32_t val;
+	int i, first = id * FUTEX_BARRIER_FANOUT + 1;
+
+	while ((val = node->arrived) != want && !b->abort)
+		futex_wait(&node->arrived, val, NULL, opflags);
+
+	if (id == 0) {
+		futex_inc(&b->arrived);
+		futex_wake(&b->arrived, 1, opflags);
+	} else {
+		i = (id - 1) / FUTEX_BARRIER_FANOUT;
+		parent = &b->nodes[i];
+		/* Only the last child to arrive wakes the parent */
+		if (futex_inc(&parent->arrived) ==
+		    round * futex_barrier_children(b, i))
+			futex_wake(&parent->arrived, 1, opflags);
+	}
+
+	while ((val = node->release) != round && !b->abort)
+		futex_wait(&node->release, val, NULL, opflags);
+	for (i = first; i < first + FUTEX_BARRIER_FANOUT && i < b->threads;
+	     i++) {
+		b->nodes[i].release = round;
+		futex_wake(&b->nodes[i].release, 1, opflags);
+	}
+	return b->value;
+}
+
+/**
+ * futex_barrier_wait() - wait for all participants to arrive, as the master
+ */
+static inline void futex_barrier_wait(struct futex_barrier *b, int opflags)
+{
+	u_int32_t round = ++b->round;
+	u_int32_t val;
+
+	while ((val = b->arrived) != round)
+		futex_wait(&b->arrived, val, NULL, opflags);
+}
+
+/**
+ * futex_barrier_release() - release the participants, as the master
+ * @value:	returned to every participant by futex_barrier_sync()
+ *
+ * Must follow futex_barrier_wait() for the same round.
+ */
+static inline void futex_barrier_release(struct futex_barrier *b, int value,
+					 int opflags)
+{
+	b->value = value;
+	__sync_synchronize();
+	b->nodes[0].release = b->round;
+	futex_wake(&b->nodes[0].release, 1, opflags);
+}
+
+/**
+ * futex_barrier_abort() - release every participant waiting at the barrier
+ * @value:	returned to every participant by futex_barrier_sync()
+ *
+ * For when some participants will never arrive, such as a failure to start
+ * them all. The barrier cannot be used again.
+ */
+static inline void futex_barrier_abort(struct futex_barrier *b, int value,
+				       int opflags)
+{
+	int i;
+
+	b->value = value;
+	b->abort = 1;
+	__sync_synchronize();
+	for (i = 0; i < b->threads; i++) {
+		futex_inc(&b->nodes[i].arrived);
+		futex_wake(&b->nodes[i].arrived, 1, opflags);
+		futex_inc(&b->nodes[i].release);
+		futex_wake(&b->nodes[i].release, 1, opflags);
+	}
+}
+
+#endif
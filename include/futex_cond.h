@@ -0,0 +1,129 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      futex_cond.h
+ *
+ * DESCRIPTION
+ *      Example condition variable for the futex_mutex2 and futex_mutex3
+ *      mutexes of futex_mutex.h. Waiters block on a sequence counter bumped
+ *      by every signal, so a signal between releasing the mutex and blocking
+ *      makes the wait return instead of being lost. A broadcast wakes one
+ *      waiter and requeues the others onto the mutex with FUTEX_CMP_REQUEUE,
+ *      so they are released one unlock at a time instead of racing for it.
+ *
+ *****************************************************************************/
+
+#ifndef _FUTEX_COND_H
+#define _FUTEX_COND_H
+
+#include <limits.h>
+#include "futextest.h"
+#include "futex_mutex.h"
+
+struct futex_cond {
+	futex_t seq;		/* bumped by every signal and broadcast */
+	futex_t waiters;	/* tasks between futex_cond_wait() and wakeup */
+};
+
+#define FUTEX_COND_INITIALIZER { 0, 0 }
+
+/**
+ * futex_cond_wait() - release a mutex and wait for a signal
+ * @cond:	the condvar
+ * @mutex:	a futex_mutex2 or futex_mutex3, held by the caller
+ *
+ * The mutex is held again on return. As with pthread_cond_wait(), the
+ * wait may end without the condition having changed, callers recheck it.
+ * The mutex is retaken as contended, since waiters a broadcast requeued
+ * onto it rely on its unlock to wake them.
+ *
+ * Return 0 when woken, -1 with errno set to EAGAIN if a signal came before
+ * the caller blocked, or EINTR.
+ */
+static inline int futex_cond_wait(struct futex_cond *cond, futex_t *mutex,
+				  int opflags)
+{
+	u_int32_t seq = cond->seq;
+	int ret;
+
+	futex_inc(&cond->waiters);
+	futex_mutex2_unlock(mutex, opflags);
+	futex_mutex_syscall();
+	ret = futex_wait(&cond->seq, seq, NULL, opflags);
+	futex_dec(&cond->waiters);
+	futex_mutex_lock_contended(mutex, opflags);
+	return ret;
+}
+
+/**
+ * futex_cond_signal() - wake one waiter
+ *
+ * The syscall is skipped when nobody waits.
+ */
+static inline void futex_cond_signal(struct futex_cond *cond, int opflags)
+{
+	futex_inc(&cond->seq);
+	if (cond->waiters) {
+		futex_mutex_syscall();
+		futex_wake(&cond->seq, 1, opflags);
+	}
+}
+
+/**
+ * futex_cond_signal_unlock() - release a mutex and wake one waiter
+ * @mutex:	a futex_mutex2 or futex_mutex3, held by the caller
+ *
+ * Equivalent to futex_mutex2_unlock() followed by futex_cond_signal(), but
+ * when there is a waiter a single FUTEX_WAKE_OP releases the mutex, wakes a
+ * task blocked on it if it was contended, and wakes the waiter.
+ */
+static inline void futex_cond_signal_unlock(struct futex_cond *cond,
+					    futex_t *mutex, int opflags)
+{
+	futex_inc(&cond->seq);
+	if (!cond->waiters) {
+		futex_mutex2_unlock(mutex, opflags);
+		return;
+	}
+	futex_mutex_syscall();
+	futex_wake_op(&cond->seq, mutex, 1, 1,
+		      FUTEX_OP(FUTEX_OP_SET, 0, FUTEX_OP_CMP_GT, 1), opflags);
+}
+
+/**
+ * futex_cond_broadcast() - wake all waiters
+ * @mutex:	the mutex the waiters passed to futex_cond_wait()
+ *
+ * If a signal races with the broadcast the requeue fails on the changed
+ * sequence and all waiters are woken instead.
+ */
+static inline void futex_cond_broadcast(struct futex_cond *cond,
+					futex_t *mutex, int opflags)
+{
+	u_int32_t seq = futex_inc(&cond->seq);
+
+	if (!cond->waiters)
+		return;
+	futex_mutex_syscall();
+	if (futex_cmp_requeue(&cond->seq, seq, mutex, 1, INT_MAX,
+			      opflags) < 0) {
+		futex_mutex_syscall();
+		futex_wake(&cond->seq, INT_MAX, opflags);
+	}
+}
+
+#endif
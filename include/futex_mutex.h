@@ -0,0 +1,388 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      futex_mutex.h
+ *
+ * DESCRIPTION
+ *      Example futex based mutexes:
+ *      o futex_mutex1: Ulrich Drepper's first mutex from "Futexes Are
+ *        Tricky", a counter of lockers, waking on every unlock
+ *      o futex_mutex2: Drepper's second mutex, 0 unlocked, 1 locked and 2
+ *        locked with possible waiters, only waking when there may be waiters
+ *      o futex_mutex3: Drepper's third mutex, the second with the contended
+ *        path using an exchange instead of two compare and exchanges
+ *      o futex_ticket: a fair mutex handing the lock to the waiters in
+ *        arrival order, each woken selectively by FUTEX_WAKE_BITSET
+ *      o futex_adaptive: the third mutex spinning with exponential backoff
+ *        for a bounded budget before blocking, optionally tuning the budget
+ *        from the spinning needed by previous acquisitions
+ *      o futex_mcs: an MCS queue lock, each waiter spinning and then blocking
+ *        on its own cache line aligned node, the owner handing the lock
+ *        directly to its successor
+ *      o futex_pi: the priority inheritance mutex of FUTEX_LOCK_PI, the
+ *        owner's TID taken and released by a cmpxchg when uncontended
+ *      Every lock and unlock takes the opflags for its futex operations,
+ *      FUTEX_PRIVATE_FLAG or 0 for a futex shared between processes.
+ *
+ *****************************************************************************/
+
+#ifndef _FUTEX_MUTEX_H
+#define _FUTEX_MUTEX_H
+
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include "futextest.h"
+
+/*
+ * futex_mutex_syscall() is evaluated before every futex syscall issued by the
+ * mutexes below. Define it before including this file to count them.
+ */
+#ifndef futex_mutex_syscall
+#define futex_mutex_syscall() do { } while (0)
+#endif
+
+static inline void futex_mutex_wait(futex_t *futex, u_int32_t val, int opflags)
+{
+	futex_mutex_syscall();
+	futex_wait(futex, val, NULL, opflags);
+}
+
+static inline void futex_mutex_wake(futex_t *futex, int opflags)
+{
+	futex_mutex_syscall();
+	futex_wake(futex, 1, opflags);
+}
+
+/**
+ * futex_mutex1_lock() - take Drepper's first mutex
+ * @futex:	the mutex, 0 when unlocked, otherwise the number of lockers
+ *
+ * Simple but slow: every unlock makes a syscall, and waiters keep failing to
+ * block as the count changes under them.
+ */
+static inline void futex_mutex1_lock(futex_t *futex, int opflags)
+{
+	u_int32_t c;
+
+	while ((c = futex_inc(futex)) != 1)
+		futex_mutex_wait(futex, c, opflags);
+}
+
+static inline void futex_mutex1_unlock(futex_t *futex, int opflags)
+{
+	*futex = 0;
+	futex_mutex_wake(futex, opflags);
+}
+
+/**
+ * futex_mutex_trylock() - take a futex_mutex2 or futex_mutex3 if it is free
+ *
+ * Return 1 if the mutex was taken, 0 otherwise.
+ */
+static inline int futex_mutex_trylock(futex_t *futex)
+{
+	return futex_cmpxchg(futex, 0, 1) == 0;
+}
+
+/**
+ * futex_mutex2_lock() - take Drepper's second mutex
+ * @futex:	the mutex, 0 unlocked, 1 locked, 2 locked with possible waiters
+ */
+static inline void futex_mutex2_lock(futex_t *futex, int opflags)
+{
+	u_int32_t c;
+
+	if ((c = futex_cmpxchg(futex, 0, 1)) == 0)
+		return;
+	do {
+		if (c == 2 || futex_cmpxchg(futex, 1, 2) != 0)
+			futex_mutex_wait(futex, 2, opflags);
+	} while ((c = futex_cmpxchg(futex, 0, 2)) != 0);
+}
+
+/**
+ * futex_mutex2_unlock() - release a futex_mutex2 or futex_mutex3
+ */
+static inline void futex_mutex2_unlock(futex_t *futex, int opflags)
+{
+	if (futex_dec(futex) != 0) {
+		*futex = 0;
+		futex_mutex_wake(futex, opflags);
+	}
+}
+
+/**
+ * futex_mutex_lock_contended() - take a futex_mutex2 or futex_mutex3 as a waiter
+ *
+ * The mutex is left marked as having waiters. Waiters woken from a condvar
+ * must lock this way, as tasks requeued onto the mutex depend on the unlock
+ * to wake them.
+ */
+static inline void futex_mutex_lock_contended(futex_t *futex, int opflags)
+{
+	while (futex_xchg(futex, 2) != 0)
+		futex_mutex_wait(futex, 2, opflags);
+}
+
+/**
+ * futex_mutex3_lock() - take Drepper's third mutex
+ * @futex:	the mutex, 0 unlocked, 1 locked, 2 locked with possible waiters
+ *
+ * futex_mutex3 is released with futex_mutex2_unlock().
+ */
+static inline void futex_mutex3_lock(futex_t *futex, int opflags)
+{
+	if (futex_cmpxchg(futex, 0, 1) != 0)
+		futex_mutex_lock_contended(futex, opflags);
+}
+
+#define futex_mutex3_unlock futex_mutex2_unlock
+
+/* Upper bound for the self tuned spin budget, in futex_cpu_relax() calls */
+#define FUTEX_SPIN_MAX		16384
+/* Longest pause between two attempts while spinning */
+#define FUTEX_BACKOFF_MAX	64
+
+static inline void futex_cpu_relax(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	asm volatile("pause" ::: "memory");
+#elif defined(__aarch64__)
+	asm volatile("yield" ::: "memory");
+#else
+	asm volatile("" ::: "memory");
+#endif
+}
+
+/*
+ * Spin for up to budget futex_cpu_relax() calls, doubling the pause between
+ * attempts to take the mutex. Store the calls spent in spent and return 1 if
+ * the mutex was taken.
+ */
+static inline int futex_adaptive_spin(futex_t *futex, int budget, int *spent)
+{
+	int delay = 1, i;
+
+	*spent = 0;
+	while (*spent < budget) {
+		for (i = 0; i < delay; i++)
+			futex_cpu_relax();
+		*spent += delay;
+		if (*futex == 0 && futex_cmpxchg(futex, 0, 1) == 0)
+			return 1;
+		if (delay < FUTEX_BACKOFF_MAX)
+			delay *= 2;
+	}
+	return 0;
+}
+
+/**
+ * futex_adaptive_lock() - take a mutex, spinning before blocking
+ * @futex:	a futex_mutex3
+ * @tune:	the self tuned spin budget, initially 0. Keep it off the
+ *		cache line of futex, it is written by every contended acquire.
+ * @spins:	spin budget in futex_cpu_relax() calls, < 0 to self tune
+ *
+ * When self tuning, the budget is twice the running average of the spinning
+ * needed by earlier acquisitions, like glibc's adaptive mutexes. Spins which
+ * took the mutex move the average towards the calls they needed, and spins
+ * which ran out of budget halve it, so it grows while the hold times are
+ * covered by spinning and decays when the mutex is mostly taken by blocking.
+ * The average is updated without synchronization, it is only a hint.
+ * Release with futex_adaptive_unlock().
+ */
+static inline void futex_adaptive_lock(futex_t *futex, futex_t *tune,
+				       int spins, int opflags)
+{
+	int budget, spent, avg, taken;
+
+	if (futex_cmpxchg(futex, 0, 1) == 0)
+		return;
+	if (spins >= 0) {
+		taken = futex_adaptive_spin(futex, spins, &spent);
+	} else {
+		avg = *tune;
+		budget = avg * 2 + 16;
+		if (budget > FUTEX_SPIN_MAX)
+			budget = FUTEX_SPIN_MAX;
+		taken = futex_adaptive_spin(futex, budget, &spent);
+		*tune = taken ? avg + (spent - avg) / 8 : avg / 2;
+	}
+	if (!taken)
+		futex_mutex_lock_contended(futex, opflags);
+}
+
+#define futex_adaptive_unlock futex_mutex2_unlock
+
+/**
+ * futex_ticket_lock() - take a ticket mutex
+ * @ticket:	two futex words, the next ticket to hand out and the ticket
+ *		being served
+ *
+ * Waiters sleep on the serving word with the bit of their ticket modulo 32,
+ * so an unlock only wakes the next waiter and those sharing its bit.
+ */
+static inline void futex_ticket_lock(futex_t *ticket, int opflags)
+{
+	u_int32_t me = futex_inc(&ticket[0]) - 1;
+	u_int32_t serving;
+
+	while ((serving = ticket[1]) != me) {
+		futex_mutex_syscall();
+		futex_wait_bitset(&ticket[1], serving, NULL, 1 << (me % 32),
+				  opflags);
+	}
+}
+
+static inline void futex_ticket_unlock(futex_t *ticket, int opflags)
+{
+	u_int32_t next = futex_inc(&ticket[1]);
+
+	if (ticket[0] != next) {
+		futex_mutex_syscall();
+		futex_wake_bitset(&ticket[1], INT_MAX, 1 << (next % 32),
+				  opflags);
+	}
+}
+
+/* Node states of a futex_mcs waiter */
+#define FUTEX_MCS_WAITING	0
+#define FUTEX_MCS_GRANTED	1
+#define FUTEX_MCS_PARKED	2
+
+/* Default spin budget of a futex_mcs waiter before it blocks */
+#define FUTEX_MCS_SPINS		256
+
+/*
+ * Per waiter queue node. Nodes are named by their index in an array shared
+ * by all users of the lock, so the queue fits in a 32 bit futex word and works
+ * across processes when the array is in shared memory.
+ */
+struct futex_mcs_node {
+	futex_t state;
+	futex_t next;		/* index + 1 of the successor, 0 if none */
+} __attribute__((aligned(64)));
+
+/**
+ * futex_mcs_lock() - take an MCS queue lock
+ * @tail:	index + 1 of the last queued node, 0 when unlocked
+ * @nodes:	the node array, one node per concurrent locker
+ * @me:		index of the caller's node, which it must not share
+ * @spins:	futex_cpu_relax() calls before blocking, < 0 for the default
+ *
+ * Each waiter only ever touches its own node and its predecessor's next
+ * link, so there is no shared word to contend on while waiting.
+ */
+static inline void futex_mcs_lock(futex_t *tail, struct futex_mcs_node *nodes,
+				  u_int32_t me, int spins, int opflags)
+{
+	struct futex_mcs_node *node = &nodes[me];
+	u_int32_t prev;
+	int i;
+
+	node->next = 0;
+	node->state = FUTEX_MCS_WAITING;
+	prev = futex_xchg(tail, me + 1);
+	if (prev == 0)
+		return;
+	nodes[prev - 1].next = me + 1;
+
+	if (spins < 0)
+		spins = FUTEX_MCS_SPINS;
+	/* Acquire loads: the critical section must not run ahead of the grant */
+	for (i = 0; i < spins; i++) {
+		if (__atomic_load_n(&node->state, __ATOMIC_ACQUIRE) ==
+		    FUTEX_MCS_GRANTED)
+			return;
+		futex_cpu_relax();
+	}
+	while (__atomic_load_n(&node->state, __ATOMIC_ACQUIRE) !=
+	       FUTEX_MCS_GRANTED) {
+		if (futex_cmpxchg(&node->state, FUTEX_MCS_WAITING,
+				  FUTEX_MCS_PARKED) == FUTEX_MCS_GRANTED)
+			break;
+		futex_mutex_wait(&node->state, FUTEX_MCS_PARKED, opflags);
+	}
+}
+
+/**
+ * futex_mcs_unlock() - hand an MCS queue lock to the next waiter
+ *
+ * The successor is only woken by a syscall if it already blocked.
+ */
+static inline void futex_mcs_unlock(futex_t *tail, struct futex_mcs_node *nodes,
+				    u_int32_t me, int opflags)
+{
+	struct futex_mcs_node *node = &nodes[me];
+	u_int32_t next = node->next;
+	int i = 0;
+
+	if (!next) {
+		if (futex_cmpxchg(tail, me + 1, 0) == me + 1)
+			return;
+		/* A successor swapped itself in but has not linked yet */
+		while (!(next = node->next))
+			if (++i % FUTEX_BACKOFF_MAX)
+				futex_cpu_relax();
+			else
+				sched_yield();
+	}
+	node = &nodes[next - 1];
+	if (futex_xchg(&node->state, FUTEX_MCS_GRANTED) == FUTEX_MCS_PARKED)
+		futex_mutex_wake(&node->state, opflags);
+}
+
+/**
+ * futex_pi_lock() - take a priority inheritance mutex
+ * @futex:	the mutex, 0 when unlocked, otherwise the owner's TID with
+ *		FUTEX_WAITERS set while tasks are blocked on it
+ * @tid:	the caller's TID
+ *
+ * The uncontended path is a TID cmpxchg in user space, as with a
+ * PTHREAD_PRIO_INHERIT mutex. FUTEX_LOCK_PI is retried on EINTR.
+ *
+ * Return 0 with the mutex held, or -1 with errno set and the mutex not held
+ * if FUTEX_LOCK_PI failed, e.g. with EDEADLK.
+ */
+static inline int futex_pi_lock(futex_t *futex, pid_t tid, int opflags)
+{
+	if (futex_cmpxchg(futex, 0, tid) == 0)
+		return 0;
+	do {
+		futex_mutex_syscall();
+		if (!futex_lock_pi(futex, NULL, 0, opflags))
+			return 0;
+	} while (errno == EINTR);
+	return -1;
+}
+
+/**
+ * futex_pi_unlock() - release a priority inheritance mutex
+ *
+ * Return 0, or -1 with errno set if FUTEX_UNLOCK_PI failed, e.g. with EPERM
+ * when the caller does not own the mutex.
+ */
+static inline int futex_pi_unlock(futex_t *futex, pid_t tid, int opflags)
+{
+	if (futex_cmpxchg(futex, tid, 0) == tid)
+		return 0;
+	futex_mutex_syscall();
+	return futex_unlock_pi(futex, opflags);
+}
+
+#endif
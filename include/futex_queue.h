@@ -0,0 +1,131 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      futex_queue.h
+ *
+ * DESCRIPTION
+ *      Example bounded multi-producer multi-consumer queue. A ring of slots
+ *      is guarded by two futex_sem semaphores, counting the free slots and
+ *      the queued items, so producers park on a full queue and consumers on
+ *      an empty one. Past the semaphores each side claims a ring position
+ *      with an atomic increment; a per slot sequence number orders a
+ *      producer after the consumer still reading the slot from the previous
+ *      lap, and a consumer after the producer still writing it.
+ *
+ *****************************************************************************/
+
+#ifndef _FUTEX_QUEUE_H
+#define _FUTEX_QUEUE_H
+
+#include <sched.h>
+#include "futextest.h"
+#include "futex_sem.h"
+
+struct futex_queue_slot {
+	futex_t seq;	/* position when free, position + 1 when full */
+	u_int64_t val;
+};
+
+struct futex_queue {
+	struct futex_sem slots __attribute__((aligned(64)));
+	struct futex_sem items __attribute__((aligned(64)));
+	futex_t head __attribute__((aligned(64)));
+	futex_t tail __attribute__((aligned(64)));
+	u_int32_t size;
+	struct futex_queue_slot *ring;
+};
+
+/**
+ * futex_queue_init() - set up an empty queue
+ * @ring:	size slots, in shared memory for a queue shared between processes
+ * @size:	a power of two, so ring positions survive wrapping at 2^32
+ */
+static inline void futex_queue_init(struct futex_queue *q,
+				    struct futex_queue_slot *ring,
+				    u_int32_t size)
+{
+	u_int32_t i;
+
+	q->slots.count = size;
+	q->slots.waiters = 0;
+	q->items.count = 0;
+	q->items.waiters = 0;
+	q->head = 0;
+	q->tail = 0;
+	q->size = size;
+	q->ring = ring;
+	for (i = 0; i < size; i++)
+		ring[i].seq = i;
+}
+
+/*
+ * Wait for the slot to reach seq. The semaphores guarantee the other side
+ * already claimed it, so this only covers a task preempted mid copy.
+ */
+static inline void futex_queue_slot_wait(struct futex_queue_slot *slot,
+					 u_int32_t seq)
+{
+	int i = 0;
+
+	while (slot->seq != seq)
+		if (++i % FUTEX_BACKOFF_MAX)
+			futex_cpu_relax();
+		else
+			sched_yield();
+	__sync_synchronize();
+}
+
+/**
+ * futex_queue_push() - append a value, blocking while the queue is full
+ */
+static inline void futex_queue_push(struct futex_queue *q, u_int64_t val,
+				    int opflags)
+{
+	struct futex_queue_slot *slot;
+	u_int32_t pos;
+
+	futex_sem_wait(&q->slots, opflags);
+	pos = futex_inc(&q->tail) - 1;
+	slot = &q->ring[pos % q->size];
+	futex_queue_slot_wait(slot, pos);
+	slot->val = val;
+	__sync_synchronize();
+	slot->seq = pos + 1;
+	futex_sem_post(&q->items, opflags);
+}
+
+/**
+ * futex_queue_pop() - remove the oldest value, blocking while the queue is empty
+ */
+static inline u_int64_t futex_queue_pop(struct futex_queue *q, int opflags)
+{
+	struct futex_queue_slot *slot;
+	u_int64_t val;
+	u_int32_t pos;
+
+	futex_sem_wait(&q->items, opflags);
+	pos = futex_inc(&q->head) - 1;
+	slot = &q->ring[pos % q->size];
+	futex_queue_slot_wait(slot, pos + 1);
+	val = slot->val;
+	__sync_synchronize();
+	slot->seq = pos + q->size;
+	futex_sem_post(&q->slots, opflags);
+	return val;
+}
+
+#endif
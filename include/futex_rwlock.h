@@ -0,0 +1,117 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      futex_rwlock.h
+ *
+ * DESCRIPTION
+ *      Example reader-writer lock parking readers and writers on the same
+ *      futex word with different FUTEX_WAIT_BITSET bitsets, so a release
+ *      wakes only the class that can make progress: one writer, or all
+ *      readers. Writers are preferred; new readers queue behind a waiting
+ *      writer so writers cannot be starved.
+ *
+ *****************************************************************************/
+
+#ifndef _FUTEX_RWLOCK_H
+#define _FUTEX_RWLOCK_H
+
+#include <limits.h>
+#include "futextest.h"
+
+/* Lock word: the number of readers, or FUTEX_RWLOCK_WRITER */
+#define FUTEX_RWLOCK_WRITER	0x80000000
+
+/* Bitsets readers and writers wait with */
+#define FUTEX_RWLOCK_READ	1
+#define FUTEX_RWLOCK_WRITE	2
+
+struct futex_rwlock {
+	futex_t lock;
+	futex_t readers_waiting;
+	futex_t writers_waiting;
+};
+
+#define FUTEX_RWLOCK_INITIALIZER { 0, 0, 0 }
+
+/**
+ * futex_rwlock_rdlock() - take the lock for reading
+ * @rw:		the rwlock
+ * @opflags:	FUTEX_PRIVATE_FLAG or 0 for a lock shared between processes
+ */
+static inline void futex_rwlock_rdlock(struct futex_rwlock *rw, int opflags)
+{
+	u_int32_t val;
+
+	while (1) {
+		val = rw->lock;
+		if (!(val & FUTEX_RWLOCK_WRITER) && !rw->writers_waiting) {
+			if (futex_cmpxchg(&rw->lock, val, val + 1) == val)
+				return;
+			continue;
+		}
+		futex_inc(&rw->readers_waiting);
+		/* Recheck now that a releasing writer will see us */
+		val = rw->lock;
+		if ((val & FUTEX_RWLOCK_WRITER) || rw->writers_waiting)
+			futex_wait_bitset(&rw->lock, val, NULL,
+					  FUTEX_RWLOCK_READ, opflags);
+		futex_dec(&rw->readers_waiting);
+	}
+}
+
+/**
+ * futex_rwlock_rdunlock() - release a read lock, waking a writer if last
+ */
+static inline void futex_rwlock_rdunlock(struct futex_rwlock *rw, int opflags)
+{
+	if (futex_dec(&rw->lock) == 0 && rw->writers_waiting)
+		futex_wake_bitset(&rw->lock, 1, FUTEX_RWLOCK_WRITE, opflags);
+}
+
+/**
+ * futex_rwlock_wrlock() - take the lock for writing
+ */
+static inline void futex_rwlock_wrlock(struct futex_rwlock *rw, int opflags)
+{
+	u_int32_t val;
+
+	while (futex_cmpxchg(&rw->lock, 0, FUTEX_RWLOCK_WRITER) != 0) {
+		futex_inc(&rw->writers_waiting);
+		val = rw->lock;
+		if (val != 0)
+			futex_wait_bitset(&rw->lock, val, NULL,
+					  FUTEX_RWLOCK_WRITE, opflags);
+		futex_dec(&rw->writers_waiting);
+	}
+}
+
+/**
+ * futex_rwlock_wrunlock() - release a write lock
+ *
+ * Wake one waiting writer if there is one, all waiting readers otherwise.
+ */
+static inline void futex_rwlock_wrunlock(struct futex_rwlock *rw, int opflags)
+{
+	futex_xchg(&rw->lock, 0);
+	if (rw->writers_waiting)
+		futex_wake_bitset(&rw->lock, 1, FUTEX_RWLOCK_WRITE, opflags);
+	else if (rw->readers_waiting)
+		futex_wake_bitset(&rw->lock, INT_MAX, FUTEX_RWLOCK_READ,
+				  opflags);
+}
+
+#endif
@@ -0,0 +1,85 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      futex_sem.h
+ *
+ * DESCRIPTION
+ *      Example counting semaphore. The count is the futex word, and a count
+ *      of blocked tasks lets a post skip the FUTEX_WAKE when nobody waits,
+ *      so neither side enters the kernel while the count stays above zero.
+ *
+ *****************************************************************************/
+
+#ifndef _FUTEX_SEM_H
+#define _FUTEX_SEM_H
+
+#include "futextest.h"
+#include "futex_mutex.h"
+
+struct futex_sem {
+	futex_t count;
+	futex_t waiters;
+};
+
+#define FUTEX_SEM_INITIALIZER(count) { (count), 0 }
+
+/**
+ * futex_sem_trywait() - take a unit of the semaphore if one is available
+ *
+ * Return 1 if a unit was taken, 0 otherwise.
+ */
+static inline int futex_sem_trywait(struct futex_sem *sem)
+{
+	u_int32_t c;
+
+	while ((c = sem->count) > 0)
+		if (futex_cmpxchg(&sem->count, c, c - 1) == c)
+			return 1;
+	return 0;
+}
+
+/**
+ * futex_sem_wait() - take a unit of the semaphore, blocking until one is posted
+ * @sem:	the semaphore
+ * @opflags:	FUTEX_PRIVATE_FLAG or 0 for a semaphore shared between processes
+ */
+static inline void futex_sem_wait(struct futex_sem *sem, int opflags)
+{
+	while (!futex_sem_trywait(sem)) {
+		futex_inc(&sem->waiters);
+		/* Recheck now that a post will see us */
+		if (sem->count == 0) {
+			futex_mutex_syscall();
+			futex_wait(&sem->count, 0, NULL, opflags);
+		}
+		futex_dec(&sem->waiters);
+	}
+}
+
+/**
+ * futex_sem_post() - release a unit of the semaphore, waking one waiter
+ */
+static inline void futex_sem_post(struct futex_sem *sem, int opflags)
+{
+	futex_inc(&sem->count);
+	if (sem->waiters) {
+		futex_mutex_syscall();
+		futex_wake(&sem->count, 1, opflags);
+	}
+}
+
+#endif
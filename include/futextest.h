@@ -33,6 +33,8 @@
 #ifndef _FUTEXTEST_H
 #define _FUTEXTEST_H
 
+#include <stdint.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
@@ -41,6 +43,12 @@
 typedef volatile u_int32_t futex_t;
 #define FUTEX_INITIALIZER 0
 
+/* The futex2 syscalls also take words of 8, 16 and 64 bits */
+typedef volatile u_int8_t futex8_t;
+typedef volatile u_int16_t futex16_t;
+typedef volatile u_int32_t futex32_t;
+typedef volatile u_int64_t futex64_t;
+
 /* Define the newer op codes if the system header file is not up to date. */
 #ifndef FUTEX_WAIT_BITSET
 #define FUTEX_WAIT_BITSET		9
@@ -62,6 +70,42 @@ typedef volatile u_int32_t futex_t;
 #define FUTEX_CMP_REQUEUE_PI_PRIVATE	(FUTEX_CMP_REQUEUE_PI | \
 					 FUTEX_PRIVATE_FLAG)
 #endif
+/* futex_waitv() and its flags, for system headers predating Linux 5.16 */
+#ifndef SYS_futex_waitv
+#define SYS_futex_waitv			449
+#endif
+#ifndef FUTEX_WAITV_MAX
+#define FUTEX_32			2
+#define FUTEX_WAITV_MAX			128
+struct futex_waitv {
+	__u64 val;
+	__u64 uaddr;
+	__u32 flags;
+	__u32 __reserved;
+};
+#endif
+#ifndef FUTEX2_PRIVATE
+#define FUTEX2_PRIVATE			FUTEX_PRIVATE_FLAG
+#endif
+/* The futex2 syscalls and their flags, for system headers predating 6.7 */
+#ifndef SYS_futex_wake
+#define SYS_futex_wake			454
+#endif
+#ifndef SYS_futex_wait
+#define SYS_futex_wait			455
+#endif
+#ifndef SYS_futex_requeue
+#define SYS_futex_requeue		456
+#endif
+#ifndef FUTEX2_SIZE_U8
+#define FUTEX2_SIZE_U8			0x00
+#define FUTEX2_SIZE_U16			0x01
+#define FUTEX2_SIZE_U32			0x02
+#define FUTEX2_SIZE_U64			0x03
+#endif
+#ifndef FUTEX2_SIZE_MASK
+#define FUTEX2_SIZE_MASK		0x03
+#endif
 
 /** 
  * futex() - SYS_futex syscall wrapper
@@ -150,7 +194,14 @@ futex_unlock_pi(futex_t *uaddr, int opflags)
 }
 
 /**
- * futex_wake_op() - FIXME: COME UP WITH A GOOD ONE LINE DESCRIPTION
+ * futex_wake_op() - modify uaddr2, wake on uaddr and conditionally on uaddr2
+ * @nr_wake:	wake up to this many tasks on uaddr
+ * @nr_wake2:	wake up to this many tasks on uaddr2, if the comparison holds
+ * @wake_op:	the operation on uaddr2 and the comparison of its old value,
+ *		encoded with FUTEX_OP() from linux/futex.h
+ *
+ * The operation on uaddr2 is atomic, and the whole call takes one syscall,
+ * such as releasing a mutex and signaling a condvar at once.
  */
 static inline int
 futex_wake_op(futex_t *uaddr, futex_t *uaddr2, int nr_wake, int nr_wake2,
@@ -220,6 +271,119 @@ futex_cmp_requeue_pi(futex_t *uaddr, futex_t val, futex_t *uaddr2, int nr_wake,
 		     opflags);
 }
 
+/**
+ * futex_waitv_set() - fill in one entry of a futex_waitv() array
+ * @w:		the entry
+ * @uaddr:	futex to wait on
+ * @val:	expected value of uaddr
+ * @opflags:	FUTEX_PRIVATE_FLAG or 0
+ */
+static inline void
+futex_waitv_set(struct futex_waitv *w, futex_t *uaddr, futex_t val,
+		int opflags)
+{
+	w->val = val;
+	w->uaddr = (uintptr_t)uaddr;
+	w->flags = FUTEX_32 | (opflags & FUTEX_PRIVATE_FLAG ? FUTEX2_PRIVATE : 0);
+	w->__reserved = 0;
+}
+
+/**
+ * futex2_waitv_set() - fill in one futex_waitv entry for a word of any size
+ * @uaddr:	futex word, naturally aligned for its size
+ * @flags:	FUTEX2_SIZE_* ORed with FUTEX2_PRIVATE
+ */
+static inline void
+futex2_waitv_set(struct futex_waitv *w, volatile void *uaddr, u_int64_t val,
+		 unsigned int flags)
+{
+	w->val = val;
+	w->uaddr = (uintptr_t)uaddr;
+	w->flags = flags;
+	w->__reserved = 0;
+}
+
+/**
+ * futex_waitv() - block on several futexes until any one of them is woken
+ * @waiters:	the futexes with their expected values, see futex_waitv_set()
+ * @nr_waiters:	number of entries, up to FUTEX_WAITV_MAX
+ * @timeout:	absolute timeout on clockid, or NULL
+ * @clockid:	CLOCK_MONOTONIC or CLOCK_REALTIME
+ *
+ * Fails with EAGAIN if any futex does not hold its expected value. Return the
+ * index of a woken futex.
+ */
+static inline int
+futex_waitv(struct futex_waitv *waiters, unsigned int nr_waiters,
+	    struct timespec *timeout, clockid_t clockid)
+{
+	return syscall(SYS_futex_waitv, waiters, nr_waiters, 0, timeout,
+		       clockid);
+}
+
+/**
+ * futex2_size() - size in bytes of the futex word selected by futex2 flags
+ */
+static inline int futex2_size(unsigned int flags)
+{
+	return 1 << (flags & FUTEX2_SIZE_MASK);
+}
+
+/**
+ * futex2_mask() - all the bits of the futex word selected by futex2 flags
+ *
+ * The futex2 calls fail with EINVAL for values and masks wider than the
+ * word, so this is the mask matching any waiter.
+ */
+static inline u_int64_t futex2_mask(unsigned int flags)
+{
+	return ~0ULL >> (64 - 8 * futex2_size(flags));
+}
+
+/**
+ * futex2_wait() - block on a futex word of any size
+ * @uaddr:	futex word, naturally aligned for its size
+ * @val:	expected value of uaddr
+ * @mask:	bitset to be used with futex2_wake(), see futex2_mask()
+ * @flags:	FUTEX2_SIZE_* ORed with FUTEX2_PRIVATE
+ * @timeout:	absolute timeout on clockid, or NULL
+ * @clockid:	CLOCK_MONOTONIC or CLOCK_REALTIME
+ *
+ * Kernels implementing only some word sizes fail the others with EINVAL.
+ */
+static inline int
+futex2_wait(volatile void *uaddr, u_int64_t val, u_int64_t mask,
+	    unsigned int flags, struct timespec *timeout, clockid_t clockid)
+{
+	return syscall(SYS_futex_wait, uaddr, val, mask, flags, timeout,
+		       clockid);
+}
+
+/**
+ * futex2_wake() - wake one or more tasks blocked on a futex word of any size
+ * @mask:	bitset to compare with that used in futex2_wait()
+ * @nr_wake:	wake up to this many tasks
+ */
+static inline int
+futex2_wake(volatile void *uaddr, u_int64_t mask, int nr_wake,
+	    unsigned int flags)
+{
+	return syscall(SYS_futex_wake, uaddr, mask, nr_wake, flags);
+}
+
+/**
+ * futex2_requeue() - requeue tasks between futex words of any size
+ * @waiters:	source and target, see futex2_waitv_set(). The requeue
+ *		fails with EAGAIN unless the source holds waiters[0].val.
+ * @nr_wake:	wake up to this many tasks
+ * @nr_requeue:	requeue up to this many tasks
+ */
+static inline int
+futex2_requeue(struct futex_waitv *waiters, int nr_wake, int nr_requeue)
+{
+	return syscall(SYS_futex_requeue, waiters, 0, nr_wake, nr_requeue);
+}
+
 /**
  * futex_cmpxchg() - atomic compare and exchange
  * @uaddr:	The address of the futex to be modified
@@ -237,6 +401,89 @@ futex_cmpxchg(futex_t *uaddr, u_int32_t oldval, u_int32_t newval)
 	return __sync_val_compare_and_swap(uaddr, oldval, newval);
 }
 
+/**
+ * futex2_cmpxchg() - atomic compare and exchange of a futex word of any size
+ * @flags:	FUTEX2_SIZE_* of the word, other bits are ignored
+ *
+ * Return the old futex value.
+ */
+static inline u_int64_t
+futex2_cmpxchg(volatile void *uaddr, u_int64_t oldval, u_int64_t newval,
+	       unsigned int flags)
+{
+	switch (flags & FUTEX2_SIZE_MASK) {
+	case FUTEX2_SIZE_U8:
+		return __sync_val_compare_and_swap((futex8_t *)uaddr, oldval,
+						   newval);
+	case FUTEX2_SIZE_U16:
+		return __sync_val_compare_and_swap((futex16_t *)uaddr, oldval,
+						   newval);
+	case FUTEX2_SIZE_U32:
+		return __sync_val_compare_and_swap((futex32_t *)uaddr, oldval,
+						   newval);
+	default:
+		return __sync_val_compare_and_swap((futex64_t *)uaddr, oldval,
+						   newval);
+	}
+}
+
+/**
+ * futex2_get() - read a futex word of any size
+ * @flags:	FUTEX2_SIZE_* of the word, other bits are ignored
+ */
+static inline u_int64_t
+futex2_get(volatile void *uaddr, unsigned int flags)
+{
+	switch (flags & FUTEX2_SIZE_MASK) {
+	case FUTEX2_SIZE_U8:
+		return *(futex8_t *)uaddr;
+	case FUTEX2_SIZE_U16:
+		return *(futex16_t *)uaddr;
+	case FUTEX2_SIZE_U32:
+		return *(futex32_t *)uaddr;
+	default:
+		return *(futex64_t *)uaddr;
+	}
+}
+
+/**
+ * futex2_set() - set a futex word of any size
+ * @flags:	FUTEX2_SIZE_* of the word, other bits are ignored
+ */
+static inline void
+futex2_set(volatile void *uaddr, u_int64_t newval, unsigned int flags)
+{
+	switch (flags & FUTEX2_SIZE_MASK) {
+	case FUTEX2_SIZE_U8:
+		*(futex8_t *)uaddr = newval;
+		break;
+	case FUTEX2_SIZE_U16:
+		*(futex16_t *)uaddr = newval;
+		break;
+	case FUTEX2_SIZE_U32:
+		*(futex32_t *)uaddr = newval;
+		break;
+	default:
+		*(futex64_t *)uaddr = newval;
+	}
+}
+
+/**
+ * futex_xchg() - atomic exchange
+ * @uaddr:	The address of the futex to be modified
+ * @newval:	The new value to assign the futex
+ *
+ * Implies a full barrier, unlike a bare __sync_lock_test_and_set().
+ *
+ * Return the old futex value.
+ */
+static inline u_int32_t
+futex_xchg(futex_t *uaddr, u_int32_t newval)
+{
+	__sync_synchronize();
+	return __sync_lock_test_and_set(uaddr, newval);
+}
+
 /**
  * futex_dec() - atomic decrement of the futex value
  * @uaddr:	The address of the futex to be modified
@@ -261,6 +508,19 @@ futex_inc(futex_t *uaddr)
 	return __sync_add_and_fetch(uaddr, 1);
 }
 
+/**
+ * futex_or() - atomic bitwise or into the futex value
+ * @uaddr:	the address of the futex to be modified
+ * @bits:	the bits to set
+ *
+ * Return the old futex value.
+ */
+static inline u_int32_t
+futex_or(futex_t *uaddr, u_int32_t bits)
+{
+	return __sync_fetch_and_or(uaddr, bits);
+}
+
 /**
  * futex_set() - atomic decrement of the futex value
  * @uaddr:	the address of the futex to be modified
@@ -33,8 +33,14 @@
 #ifndef _LOGGING_H
 #define _LOGGING_H
 
+#include <errno.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/utsname.h>
 #include <linux/futex.h>
 
 /*
@@ -70,6 +76,12 @@ char *FAIL = FAIL_NORMAL;
 #define VMAX      VINFO
 int _verbose = VCRITICAL;
 
+/* Output formats for test records, see log_output() */
+#define OUTPUT_TEXT 0
+#define OUTPUT_JSON 1
+#define OUTPUT_CSV  2
+int _output = OUTPUT_TEXT;
+
 /* Functional test return codes */
 #define RET_PASS   0
 #define RET_ERROR -1
@@ -155,4 +167,246 @@ do { \
 		fprintf(stderr, "\t%s: "message, FAIL, ##args); \
 } while (0)
 
+/*
+ * Structured test records. A record is a flat list of named fields, built
+ * with record_begin() and record_str()/record_num() and emitted as one JSON
+ * object or one CSV header plus row by record_end(). Nothing is recorded or
+ * emitted in the default text mode.
+ */
+#define RECORD_MAX_FIELDS 64
+
+struct record_field {
+	char *key;
+	char *val;
+	int quote;
+};
+
+static struct record_field _record[RECORD_MAX_FIELDS];
+static int _record_fields;
+static FILE *_record_file;
+
+/**
+ * log_output() - select the output format: text, json or csv
+ * @format:	the format name
+ *
+ * In json and csv modes stdout carries only the records, the usual text
+ * output is redirected to stderr. Return 0 on success, -1 for an unknown
+ * format.
+ */
+int log_output(const char *format)
+{
+	int fd;
+
+	if (!strcmp(format, "text")) {
+		_output = OUTPUT_TEXT;
+		return 0;
+	}
+	if (!strcmp(format, "json"))
+		_output = OUTPUT_JSON;
+	else if (!strcmp(format, "csv"))
+		_output = OUTPUT_CSV;
+	else
+		return -1;
+
+	if (!_record_file) {
+		fflush(stdout);
+		if ((fd = dup(STDOUT_FILENO)) < 0 ||
+		    !(_record_file = fdopen(fd, "w")))
+			return -1;
+		dup2(STDERR_FILENO, STDOUT_FILENO);
+	}
+	return 0;
+}
+
+static void record_add(const char *key, char *val, int quote)
+{
+	char *name;
+
+	if (!val)
+		return;
+	if (_record_fields == RECORD_MAX_FIELDS || !(name = strdup(key))) {
+		free(val);
+		return;
+	}
+	_record[_record_fields].key = name;
+	_record[_record_fields].val = val;
+	_record[_record_fields].quote = quote;
+	_record_fields++;
+}
+
+static void record_clear(void)
+{
+	while (_record_fields) {
+		_record_fields--;
+		free(_record[_record_fields].key);
+		free(_record[_record_fields].val);
+	}
+}
+
+/**
+ * record_str() - add a string field to the current record
+ * @key:	field name
+ */
+void record_str(const char *key, const char *fmt, ...)
+{
+	va_list ap;
+	char *val;
+
+	if (_output == OUTPUT_TEXT)
+		return;
+	va_start(ap, fmt);
+	if (vasprintf(&val, fmt, ap) < 0)
+		val = NULL;
+	va_end(ap);
+	record_add(key, val, 1);
+}
+
+/**
+ * record_num() - add a numeric field to the current record
+ * @key:	field name
+ *
+ * A NaN or infinite num, such as NAN for a value that could not be computed,
+ * is written as null in json and left empty in csv.
+ */
+void record_num(const char *key, double num)
+{
+	char *val;
+
+	if (_output == OUTPUT_TEXT)
+		return;
+	if (!isfinite(num))
+		val = strdup(_output == OUTPUT_JSON ? "null" : "");
+	else if (asprintf(&val, "%.10g", num) < 0)
+		val = NULL;
+	record_add(key, val, 0);
+}
+
+/* Return the first "model name" from /proc/cpuinfo, or "unknown" */
+static char *cpu_model(char *buf, int len)
+{
+	char line[256], *p;
+	FILE *f;
+
+	snprintf(buf, len, "unknown");
+	if (!(f = fopen("/proc/cpuinfo", "r")))
+		return buf;
+	while (fgets(line, sizeof(line), f)) {
+		if (strncmp(line, "model name", 10) || !(p = strchr(line, ':')))
+			continue;
+		for (p++; *p == ' ' || *p == '\t'; p++)
+			;
+		p[strcspn(p, "\n")] = 0;
+		snprintf(buf, len, "%s", p);
+		break;
+	}
+	fclose(f);
+	return buf;
+}
+
+/* Return the command line of this process with arguments space separated */
+static char *command_line(char *buf, int len)
+{
+	FILE *f;
+	int i, n = 0;
+
+	buf[0] = 0;
+	if ((f = fopen("/proc/self/cmdline", "r"))) {
+		n = fread(buf, 1, len - 1, f);
+		fclose(f);
+	}
+	for (i = 0; i < n; i++)
+		if (!buf[i])
+			buf[i] = ' ';
+	while (n > 0 && buf[n - 1] == ' ')
+		n--;
+	buf[n] = 0;
+	return buf;
+}
+
+/**
+ * record_begin() - start a new record describing this run
+ *
+ * The test name, command line, kernel release and CPU model are added
+ * automatically.
+ */
+void record_begin(void)
+{
+	struct utsname uts;
+	char buf[1024];
+
+	record_clear();
+	if (_output == OUTPUT_TEXT)
+		return;
+	record_str("test", "%s", program_invocation_short_name);
+	record_str("command", "%s", command_line(buf, sizeof(buf)));
+	record_str("kernel", "%s", uname(&uts) ? "unknown" : uts.release);
+	record_str("cpu", "%s", cpu_model(buf, sizeof(buf)));
+}
+
+static void record_json_str(const char *s)
+{
+	fputc('"', _record_file);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(_record_file, "\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			fprintf(_record_file, "\\u%04x", *s);
+		else
+			fputc(*s, _record_file);
+	}
+	fputc('"', _record_file);
+}
+
+static void record_csv_str(const char *s)
+{
+	if (!strpbrk(s, ",\"\n")) {
+		fputs(s, _record_file);
+		return;
+	}
+	fputc('"', _record_file);
+	for (; *s; s++) {
+		if (*s == '"')
+			fputc('"', _record_file);
+		fputc(*s, _record_file);
+	}
+	fputc('"', _record_file);
+}
+
+/**
+ * record_end() - emit the current record in the selected format
+ */
+void record_end(void)
+{
+	int i;
+
+	if (_output == OUTPUT_JSON) {
+		fputc('{', _record_file);
+		for (i = 0; i < _record_fields; i++) {
+			if (i)
+				fputs(", ", _record_file);
+			record_json_str(_record[i].key);
+			fputs(": ", _record_file);
+			if (_record[i].quote)
+				record_json_str(_record[i].val);
+			else
+				fputs(_record[i].val, _record_file);
+		}
+		fputs("}\n", _record_file);
+	} else if (_output == OUTPUT_CSV) {
+		for (i = 0; i < _record_fields; i++) {
+			fputs(i ? "," : "", _record_file);
+			record_csv_str(_record[i].key);
+		}
+		fputc('\n', _record_file);
+		for (i = 0; i < _record_fields; i++) {
+			fputs(i ? "," : "", _record_file);
+			record_csv_str(_record[i].val);
+		}
+		fputc('\n', _record_file);
+	}
+	if (_record_file)
+		fflush(_record_file);
+	record_clear();
+}
+
 #endif
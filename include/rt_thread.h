@@ -0,0 +1,77 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      rt_thread.h
+ *
+ * DESCRIPTION
+ *      Create threads with an explicit scheduling policy and priority, as
+ *      used by the priority inheritance tests.
+ *
+ *****************************************************************************/
+
+#ifndef _RT_THREAD_H
+#define _RT_THREAD_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include "logging.h"
+
+/**
+ * create_rt_thread() - start a thread with a given policy and priority
+ * @pth:	the new thread
+ * @func:	thread function
+ * @arg:	argument of func
+ * @policy:	SCHED_FIFO, SCHED_RR or SCHED_OTHER
+ * @prio:	priority within policy
+ *
+ * Return 0 on success, -1 after logging the failing call otherwise.
+ */
+static inline int create_rt_thread(pthread_t *pth, void*(*func)(void*),
+				   void *arg, int policy, int prio)
+{
+	int ret;
+	struct sched_param schedp;
+	pthread_attr_t attr;
+
+	pthread_attr_init(&attr);
+	memset(&schedp, 0, sizeof(schedp));
+
+	if ((ret = pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED)) != 0) {
+		error("pthread_attr_setinheritsched\n", ret);
+		goto out;
+	}
+
+	if ((ret = pthread_attr_setschedpolicy(&attr, policy)) != 0) {
+		error("pthread_attr_setschedpolicy\n", ret);
+		goto out;
+	}
+
+	schedp.sched_priority = prio;
+	if ((ret = pthread_attr_setschedparam(&attr, &schedp)) != 0) {
+		error("pthread_attr_setschedparam\n", ret);
+		goto out;
+	}
+
+	if ((ret = pthread_create(pth, &attr, func, arg)) != 0)
+		error("pthread_create\n", ret);
+out:
+	pthread_attr_destroy(&attr);
+	return ret ? -1 : 0;
+}
+
+#endif
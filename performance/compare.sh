@@ -0,0 +1,228 @@
+#!/bin/sh
+
+###############################################################################
+#
+#   This program is free software;  you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation; either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+#   the GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program;  if not, write to the Free Software
+#   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+#
+# NAME
+#      compare.sh
+#
+# DESCRIPTION
+#      Run a locktest thread sweep R times per thread count and compare the
+#      throughput against a baseline file. The baseline holds the median,
+#      mean, standard deviation and 95% confidence interval of the mean for
+#      each thread count. It is written when it does not exist yet or -s is
+#      given, otherwise every thread count is checked with Welch's t-test
+#      and a change is only reported when it is significant at the 5% level.
+#      The result is FAIL and the exit status 1 if any thread count
+#      regressed, PASS otherwise or when the baseline was saved.
+#
+###############################################################################
+
+REPEAT=5
+SAVE=0
+BASELINE=
+THREAD_COUNTS=${THREAD_COUNTS:-"1 2 3 4 5 6 8 10 12 16 24 32 64 128 256 512 1024"}
+LOCKTEST_ARGS=${LOCKTEST_ARGS:-"-w 1s -d 5s"}
+
+usage() {
+    echo "Usage: $(basename $0) [-r R] [-s] [-n THREADS] -b FILE [TEST [ARGS...]]"
+    echo "  -b FILE	Baseline file to write or compare against"
+    echo "  -h	Display this help message"
+    echo "  -n N	Thread counts to sweep (default: \"$THREAD_COUNTS\")"
+    echo "  -r R	Runs per thread count (default: $REPEAT)"
+    echo "  -s	Save a new baseline even if FILE exists"
+    echo "  TEST defaults to ./futex_wait, ARGS are passed to every run"
+    echo "  along with LOCKTEST_ARGS (default: \"$LOCKTEST_ARGS\")"
+}
+
+while getopts "b:hn:r:s" OPT; do
+    case $OPT in
+    b) BASELINE=$OPTARG ;;
+    h) usage; exit 0 ;;
+    n) THREAD_COUNTS=$OPTARG ;;
+    r) REPEAT=$OPTARG ;;
+    s) SAVE=1 ;;
+    *) usage; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+if [ -z "$BASELINE" ] || [ "$REPEAT" -lt 2 ]; then
+    usage
+    exit 1
+fi
+TEST=${1:-./futex_wait}
+[ $# -gt 0 ] && shift
+[ -f "$BASELINE" ] || SAVE=1
+
+# Throughput of one run, taken from the csv record by column name
+run_once() {
+    $TEST $LOCKTEST_ARGS "$@" -o csv 2>/dev/null | awk '
+    function csv_split(line, f,    n, i, c, q, v) {
+        n = 0; v = ""; q = 0
+        for (i = 1; i <= length(line); i++) {
+            c = substr(line, i, 1)
+            if (q && c == "\"" && substr(line, i + 1, 1) == "\"") {
+                v = v c; i++
+            } else if (c == "\"") {
+                q = !q
+            } else if (c == "," && !q) {
+                f[++n] = v; v = ""
+            } else {
+                v = v c
+            }
+        }
+        f[++n] = v
+        return n
+    }
+    NR == 1 {
+        n = csv_split($0, head)
+        for (i = 1; i <= n; i++)
+            if (head[i] == "throughput")
+                col = i
+    }
+    NR == 2 && col {
+        csv_split($0, row)
+        print row[col]
+    }'
+}
+
+SAMPLES=$(mktemp)
+trap 'rm -f $SAMPLES' EXIT
+
+echo "$(basename $TEST): Compare throughput against a baseline"
+echo "	Arguments: baseline=$BASELINE repeat=$REPEAT mode=$([ $SAVE -eq 1 ] && echo save || echo check) args=\"$LOCKTEST_ARGS $*\""
+
+for THREADS in $THREAD_COUNTS; do
+    R=0
+    while [ $R -lt $REPEAT ]; do
+        VALUE=$(run_once -n $THREADS "$@")
+        if [ -z "$VALUE" ]; then
+            echo "	ERROR: $TEST -n $THREADS produced no record" >&2
+            echo "Result: ERROR"
+            exit 1
+        fi
+        echo "$THREADS $VALUE" >> $SAMPLES
+        R=$((R + 1))
+    done
+done
+
+# Summarize the samples as: threads n median mean sd ci_lo ci_hi
+STATS='
+function tcrit(df,    z, t) {
+    # Two sided 95% quantile of Student t, Cornish-Fisher beyond df 2
+    if (df < 1)
+        return 0
+    if (df < 2)
+        return 12.706
+    if (df < 3)
+        return 4.303
+    z = 1.959964
+    t = z + (z^3 + z) / (4 * df)
+    t += (5 * z^5 + 16 * z^3 + 3 * z) / (96 * df^2)
+    t += (3 * z^7 + 19 * z^5 + 17 * z^3 - 15 * z) / (384 * df^3)
+    return t
+}'
+
+summarize() {
+    awk "$STATS"'
+    {
+        if (!($1 in n))
+            order[++keys] = $1
+        v[$1, ++n[$1]] = $2
+    }
+    END {
+        for (k = 1; k <= keys; k++) {
+            t = order[k]; m = n[t]
+            for (i = 1; i <= m; i++)
+                s[i] = v[t, i]
+            for (i = 2; i <= m; i++)
+                for (j = i; j > 1 && s[j - 1] > s[j]; j--) {
+                    x = s[j]; s[j] = s[j - 1]; s[j - 1] = x
+                }
+            med = m % 2 ? s[(m + 1) / 2] : (s[m / 2] + s[m / 2 + 1]) / 2
+            sum = 0
+            for (i = 1; i <= m; i++)
+                sum += s[i]
+            mean = sum / m
+            ss = 0
+            for (i = 1; i <= m; i++)
+                ss += (s[i] - mean)^2
+            sd = sqrt(ss / (m - 1))
+            h = tcrit(m - 1) * sd / sqrt(m)
+            printf "%s %d %.1f %.1f %.1f %.1f %.1f\n", t, m, med, mean,
+                sd, mean - h, mean + h
+        }
+    }' $SAMPLES
+}
+
+if [ $SAVE -eq 1 ]; then
+    {
+        echo "# $(basename $TEST) baseline: kernel=$(uname -r) repeat=$REPEAT args=$LOCKTEST_ARGS $*"
+        echo "# threads n median mean sd ci_lo ci_hi (Kiter/s)"
+        summarize
+    } > $BASELINE
+    awk '!/^#/ {
+        printf "\tthreads=%s: median=%.0f mean=%.0f ci=[%.0f, %.0f] Kiter/s\n",
+            $1, $3, $4, $6, $7
+    }' $BASELINE
+    printf "\tBaseline: saved to %s\n" "$BASELINE"
+    echo "Result: PASS"
+    exit 0
+fi
+
+summarize | awk "$STATS"'
+NR == FNR {
+    if ($0 !~ /^#/) {
+        bn[$1] = $2; bmed[$1] = $3; bmean[$1] = $4; bsd[$1] = $5
+    }
+    next
+}
+FNR == 1 {
+    printf "\t%7s %10s %10s %8s %7s %s\n", "threads", "base", "median",
+        "delta", "t", "verdict"
+}
+{
+    if (!($1 in bn)) {
+        printf "\t%7s %10s %10.0f %8s %7s %s\n", $1, "-", $3, "-", "-",
+            "no baseline"
+        next
+    }
+    n1 = bn[$1]; m1 = bmean[$1]; v1 = bsd[$1]^2 / n1
+    n2 = $2; m2 = $4; v2 = $5^2 / n2
+    se = sqrt(v1 + v2)
+    verdict = "ok"
+    t = 0
+    if (se > 0) {
+        t = (m2 - m1) / se
+        df = (v1 + v2)^2 / (v1^2 / (n1 - 1) + v2^2 / (n2 - 1))
+        if (t < -tcrit(df))
+            verdict = "REGRESSION"
+        else if (t > tcrit(df))
+            verdict = "improvement"
+    } else if (m2 != m1) {
+        verdict = m2 < m1 ? "REGRESSION" : "improvement"
+    }
+    if (verdict == "REGRESSION")
+        regressions++
+    delta = bmed[$1] ? 100 * ($3 - bmed[$1]) / bmed[$1] : 0
+    printf "\t%7s %10.0f %10.0f %+7.1f%% %7.2f %s\n", $1, bmed[$1], $3,
+        delta, t, verdict
+}
+END {
+    printf "\tRegressions: %d\n", regressions
+    printf "Result: %s\n", regressions ? "FAIL" : "PASS"
+    exit regressions > 0
+}' $BASELINE -
@@ -0,0 +1,244 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      futex_barrier.c
+ *
+ * DESCRIPTION
+ *      Measure barrier round trips with N threads using one of:
+ *      o the futex_barrier.h tree barrier released by a master (default)
+ *      o the linear harness barrier, every thread decrementing one counter
+ *        and the master waking them all with one FUTEX_WAKE (-m linear)
+ *      o glibc's pthread_barrier between the threads (-m pthread)
+ *      The time between two consecutive rounds and the release skew, the
+ *      spread of the times the threads leave the same round, are reported.
+ *
+ *****************************************************************************/
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "futextest.h"
+#include "logging.h"
+#include "harness.h"
+
+#define MODE_TREE	0
+#define MODE_LINEAR	1
+#define MODE_PTHREAD	2
+
+static const char *modes[] = { "tree", "linear", "pthread" };
+
+static int threads = 64;
+static int rounds = 1000;
+static int mode = MODE_TREE;
+
+struct barrier_shared {
+	struct futex_barrier tree;
+	/* Alternate rounds, so one is reset while the other is in use */
+	struct thread_barrier linear[2];
+	pthread_barrier_t pthread;
+	u_int64_t *stamp[2];	/* when each thread left the round */
+	struct histogram round;
+	struct histogram skew;
+	u_int64_t first, last;	/* when thread 0 left the first and last round */
+};
+
+struct barrier_thread {
+	struct barrier_shared *shared;
+	int id;
+};
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -c	Use color\n");
+	printf("  -h	Display this help message\n");
+	printf("  -i I	Number of rounds (default: %d)\n", rounds);
+	printf("  -m M	Barrier: tree, linear or pthread (default: tree)\n");
+	printf("  -n N	Number of threads (default: %d)\n", threads);
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+}
+
+static int barrier_round(struct barrier_thread *self, int r)
+{
+	struct barrier_shared *shared = self->shared;
+
+	switch (mode) {
+	case MODE_LINEAR:
+		return barrier_sync(&shared->linear[r % 2]);
+	case MODE_PTHREAD:
+		pthread_barrier_wait(&shared->pthread);
+		return 1;
+	default:
+		return futex_barrier_sync(&shared->tree, self->id,
+					  FUTEX_PRIVATE_FLAG);
+	}
+}
+
+/* Master side of the linear and tree barriers, releasing each round */
+static void master_round(struct barrier_shared *shared, int r)
+{
+	if (mode == MODE_LINEAR) {
+		barrier_wait(&shared->linear[r % 2]);
+		/* Every thread has left the previous round's barrier */
+		barrier_init(&shared->linear[(r + 1) % 2], threads);
+		barrier_unblock(&shared->linear[r % 2], 1);
+	} else {
+		futex_barrier_wait(&shared->tree, FUTEX_PRIVATE_FLAG);
+		futex_barrier_release(&shared->tree, 1, FUTEX_PRIVATE_FLAG);
+	}
+}
+
+static void *barrier_thread(void *arg)
+{
+	struct barrier_thread *self = arg;
+	struct barrier_shared *shared = self->shared;
+	u_int64_t *prev, first, last;
+	int r, i;
+
+	for (r = 0; r < rounds; r++) {
+		if (barrier_round(self, r) <= 0)
+			return NULL;
+		shared->stamp[r % 2][self->id] = harness_now();
+		if (self->id)
+			continue;
+		shared->last = shared->stamp[r % 2][0];
+		if (!r) {
+			shared->first = shared->last;
+			continue;
+		}
+
+		/*
+		 * All threads left round r - 1 before arriving at round r, and
+		 * none can leave round r + 1 before thread 0 arrives at it.
+		 */
+		prev = shared->stamp[(r - 1) % 2];
+		first = last = prev[0];
+		for (i = 1; i < threads; i++) {
+			if (prev[i] < first)
+				first = prev[i];
+			if (prev[i] > last)
+				last = prev[i];
+		}
+		hist_add(&shared->skew, last - first);
+		hist_add(&shared->round, shared->stamp[r % 2][0] - prev[0]);
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct barrier_shared shared;
+	struct barrier_thread *tdata;
+	struct futex_barrier_node *nodes;
+	pthread_t *thread;
+	int i, r, c;
+
+	while ((c = getopt(argc, argv, "chi:m:n:v:")) != -1) {
+		switch(c) {
+		case 'c':
+			log_color(1);
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'i':
+			rounds = atoi(optarg);
+			break;
+		case 'm':
+			for (mode = 0; mode < 3; mode++)
+				if (!strcmp(optarg, modes[mode]))
+					break;
+			if (mode == 3) {
+				usage(basename(argv[0]));
+				exit(1);
+			}
+			break;
+		case 'n':
+			threads = atoi(optarg);
+			break;
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	printf("%s: Measure %s barrier round trips\n", basename(argv[0]),
+	       modes[mode]);
+	printf("\tArguments: rounds=%d threads=%d\n", rounds, threads);
+
+	tdata = calloc(threads, sizeof(*tdata));
+	thread = calloc(threads, sizeof(*thread));
+	shared.stamp[0] = calloc(threads, sizeof(u_int64_t));
+	shared.stamp[1] = calloc(threads, sizeof(u_int64_t));
+	if (!tdata || !thread || !shared.stamp[0] || !shared.stamp[1] ||
+	    posix_memalign((void **)&nodes, 64, threads * sizeof(*nodes))) {
+		error("allocating thread data\n", errno);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+
+	futex_barrier_init(&shared.tree, nodes, threads);
+	barrier_init(&shared.linear[0], threads);
+	barrier_init(&shared.linear[1], threads);
+	pthread_barrier_init(&shared.pthread, NULL, threads);
+	hist_init(&shared.round);
+	hist_init(&shared.skew);
+
+	for (i = 0; i < threads; i++) {
+		tdata[i].shared = &shared;
+		tdata[i].id = i;
+		if (pthread_create(thread + i, NULL, barrier_thread,
+				   tdata + i)) {
+			error("pthread_create\n", errno);
+			/*
+			 * Could not create thread; abort. Threads in
+			 * pthread_barrier_wait() go away with the process.
+			 */
+			futex_barrier_abort(&shared.tree, -1,
+					    FUTEX_PRIVATE_FLAG);
+			barrier_unblock(&shared.linear[0], -1);
+			while (mode != MODE_PTHREAD && --i >= 0)
+				pthread_join(thread[i], NULL);
+			print_result(RET_ERROR);
+			return RET_ERROR;
+		}
+	}
+	if (mode != MODE_PTHREAD)
+		for (r = 0; r < rounds; r++)
+			master_round(&shared, r);
+	for (i = 0; i < threads; i++)
+		pthread_join(thread[i], NULL);
+
+	hist_print("Round", &shared.round);
+	hist_print("Release skew", &shared.skew);
+	printf("Result: %.2f us\n", rounds > 1 ?
+	       (shared.last - shared.first) / 1000.0 / (rounds - 1) : 0.);
+
+	pthread_barrier_destroy(&shared.pthread);
+	free(nodes);
+	free(shared.stamp[1]);
+	free(shared.stamp[0]);
+	free(thread);
+	free(tdata);
+	return RET_PASS;
+}
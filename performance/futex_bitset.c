@@ -0,0 +1,277 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      futex_bitset.c
+ *
+ * DESCRIPTION
+ *      Measure the cost of waking one event class out of several. N waiters
+ *      are spread over B classes, waiting on a single futex word with
+ *      FUTEX_WAIT_BITSET and the bit of their class, and each round wakes
+ *      every waiter of one class with FUTEX_WAKE_BITSET. The kernel walks
+ *      all waiters hashed with the word to find the matching ones, so the
+ *      cost grows with N rather than N/B. With -p each class has its own
+ *      futex word instead, woken by FUTEX_WAKE. Each round also wakes a
+ *      class nobody waits on, which costs the bare scan of the waiters.
+ *
+ *****************************************************************************/
+
+#include <getopt.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "atomic.h"
+#include "futextest.h"
+#include "logging.h"
+#include "harness.h"
+
+/* Time for re-parked waiters to get from the counter into the kernel */
+#define SETTLE_US 50
+
+#define MAX_CLASSES 32
+
+static int threads = 256;
+static int classes = 8;
+static int rounds = 1000;
+static int per_class = 0;
+
+struct class_futex {
+	futex_t futex;
+} __attribute__((aligned(64)));
+
+struct bitset_shared {
+	struct thread_barrier barrier;
+	futex_t futex;
+	/* The last one is never waited on */
+	struct class_futex class[MAX_CLASSES + 1];
+	atomic_t parked;
+	atomic_t woken;
+	volatile int stop;
+};
+
+struct bitset_thread {
+	struct bitset_shared *shared;
+	int class;
+};
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -b B	Number of event classes, up to %d (default: %d)\n",
+	       MAX_CLASSES, classes);
+	printf("  -c	Use color\n");
+	printf("  -h	Display this help message\n");
+	printf("  -i I	Number of wake rounds (default: %d)\n", rounds);
+	printf("  -n N	Number of waiting threads (default: %d)\n", threads);
+	printf("  -p	Use one futex per class instead of one bit per class\n");
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+}
+
+static void *waiter_thread(void *arg)
+{
+	struct bitset_thread *self = arg;
+	struct bitset_shared *shared = self->shared;
+	int ret;
+
+	if (barrier_sync(&shared->barrier) <= 0)
+		return NULL;
+
+	atomic_inc(&shared->parked);
+	while (1) {
+		if (per_class)
+			ret = futex_wait(&shared->class[self->class].futex, 0,
+					 NULL, FUTEX_PRIVATE_FLAG);
+		else
+			ret = futex_wait_bitset(&shared->futex, 0, NULL,
+						1 << self->class,
+						FUTEX_PRIVATE_FLAG);
+		if (shared->stop)
+			break;
+		if (ret)
+			continue;	/* EINTR, still parked */
+		atomic_inc(&shared->woken);
+	}
+	return NULL;
+}
+
+/*
+ * Wait for all waiters to be back on their futex, yielding to let them run.
+ * They count themselves woken just before blocking again, so the settle
+ * time is a heuristic, and rounds finding a waiter still awake are dropped.
+ */
+static void wait_parked(struct bitset_shared *shared, int woken)
+{
+	while (shared->woken.val < woken)
+		sched_yield();
+	usleep(SETTLE_US);
+}
+
+int main(int argc, char *argv[])
+{
+	struct bitset_shared shared;
+	struct bitset_thread *tdata;
+	struct histogram wake, empty;
+	u_int64_t before, after, elapsed = 0, woken = 0, counted = 0;
+	pthread_t *thread;
+	long discarded = 0;
+	int i, r, ret, c, expected;
+
+	while ((c = getopt(argc, argv, "b:chi:n:pv:")) != -1) {
+		switch(c) {
+		case 'b':
+			classes = atoi(optarg);
+			break;
+		case 'c':
+			log_color(1);
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'i':
+			rounds = atoi(optarg);
+			break;
+		case 'n':
+			threads = atoi(optarg);
+			break;
+		case 'p':
+			per_class = 1;
+			break;
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	printf("%s: Measure waking one class with %s\n", basename(argv[0]),
+	       per_class ? "a futex per class" : "FUTEX_WAKE_BITSET");
+	printf("\tArguments: rounds=%d threads=%d classes=%d\n", rounds,
+	       threads, classes);
+
+	if (classes < 1 || classes > MAX_CLASSES) {
+		error("classes must be between 1 and %d\n", 0, MAX_CLASSES);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+
+	tdata = calloc(threads, sizeof(*tdata));
+	thread = calloc(threads, sizeof(*thread));
+	if (!tdata || !thread) {
+		error("calloc\n", errno);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+
+	memset(&shared, 0, sizeof(shared));
+	barrier_init(&shared.barrier, threads);
+	for (i = 0; i < threads; i++) {
+		tdata[i].shared = &shared;
+		tdata[i].class = i % classes;
+		if (pthread_create(thread + i, NULL, waiter_thread, tdata + i)) {
+			error("pthread_create\n", errno);
+			/* Could not create thread; abort */
+			barrier_unblock(&shared.barrier, -1);
+			while (--i >= 0)
+				pthread_join(thread[i], NULL);
+			free(thread);
+			free(tdata);
+			print_result(RET_ERROR);
+			return RET_ERROR;
+		}
+	}
+	barrier_wait(&shared.barrier);
+	barrier_unblock(&shared.barrier, 1);
+	while (shared.parked.val < threads)
+		sched_yield();
+
+	hist_init(&wake);
+	hist_init(&empty);
+	for (r = 0; r < rounds; r++) {
+		wait_parked(&shared, woken);
+		before = harness_now();
+		if (per_class)
+			futex_wake(&shared.class[MAX_CLASSES].futex, INT_MAX,
+				   FUTEX_PRIVATE_FLAG);
+		else if (classes < MAX_CLASSES)
+			futex_wake_bitset(&shared.futex, INT_MAX, 1 << classes,
+					  FUTEX_PRIVATE_FLAG);
+		hist_add(&empty, harness_now() - before);
+
+		before = harness_now();
+		if (per_class)
+			ret = futex_wake(&shared.class[r % classes].futex,
+					 INT_MAX, FUTEX_PRIVATE_FLAG);
+		else
+			ret = futex_wake_bitset(&shared.futex, INT_MAX,
+						1 << (r % classes),
+						FUTEX_PRIVATE_FLAG);
+		after = harness_now();
+		if (ret < 0) {
+			error("futex_wake\n", errno);
+			continue;
+		}
+		woken += ret;
+		/* The waiters of class c are those with i % classes == c */
+		expected = threads / classes + (r % classes < threads % classes);
+		if (ret < expected) {
+			if (++discarded > rounds)
+				break;
+			r--;
+			continue;
+		}
+		hist_add(&wake, after - before);
+		elapsed += after - before;
+		counted += ret;
+	}
+
+	/* Release the waiters for good */
+	wait_parked(&shared, woken);
+	shared.stop = 1;
+	shared.futex = 1;
+	futex_wake_bitset(&shared.futex, INT_MAX, FUTEX_BITSET_MATCH_ANY,
+			  FUTEX_PRIVATE_FLAG);
+	for (i = 0; i < classes; i++) {
+		shared.class[i].futex = 1;
+		futex_wake(&shared.class[i].futex, INT_MAX,
+			   FUTEX_PRIVATE_FLAG);
+	}
+	for (i = 0; i < threads; i++)
+		pthread_join(thread[i], NULL);
+	free(thread);
+	free(tdata);
+
+	if (discarded > rounds) {
+		error("over %d rounds found too few waiters asleep\n", 0,
+		      rounds);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+	hist_print("Wake", &wake);
+	if (per_class || classes < MAX_CLASSES)
+		hist_print("Empty wake", &empty);
+	printf("\tWoken: %.1f per call of %d waiters, %.0fns per task\n",
+	       rounds ? (double)counted / rounds : 0., threads,
+	       counted ? (double)elapsed / counted : 0.);
+	printf("\tDiscarded: %ld rounds with too few waiters asleep\n",
+	       discarded);
+	printf("Result: %.0f ns\n", rounds ? (double)elapsed / rounds : 0.);
+
+	return RET_PASS;
+}
@@ -0,0 +1,347 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      futex_cond.c
+ *
+ * DESCRIPTION
+ *      Producers and consumers passing items through a bounded buffer
+ *      guarded by a mutex and two condition variables, not empty and not
+ *      full, using the futex_cond.h condvar or glibc's pthread_cond (-g).
+ *      Each side signals the other after releasing the mutex, or broadcasts
+ *      with -b. The cost of the signal or broadcast calls, the syscalls they
+ *      make and the share of wakeups finding the buffer still empty or full
+ *      (spurious) are reported along with the item throughput.
+ *
+ *****************************************************************************/
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "futextest.h"
+#include "logging.h"
+#include "harness.h"
+#include "futex_cond.h"
+
+static int producers = 4;
+static int consumers = 4;
+static int depth = 16;
+static int broadcast = 0;
+static int glibc = 0;
+static long long duration = 5000000000LL;
+
+struct cond_shared {
+	struct thread_barrier barrier_before;
+	struct thread_barrier barrier_after;
+	futex_t mutex;
+	struct futex_cond not_empty;
+	struct futex_cond not_full;
+	pthread_mutex_t pmutex;
+	pthread_cond_t pnot_empty;
+	pthread_cond_t pnot_full;
+	long items;		/* in the buffer, under the mutex */
+	long produced;
+	long consumed;
+	volatile int stop;
+};
+
+struct cond_thread {
+	struct cond_shared *shared;
+	int producer;
+	long ops;
+	long wakeups;
+	long spurious;
+	long signals;
+	long syscalls;
+	struct histogram signal;
+};
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -b	Broadcast instead of signaling\n");
+	printf("  -c	Use color\n");
+	printf("  -d D	Run for duration D (default: 5s)\n");
+	printf("  -g	Use glibc's pthread_mutex and pthread_cond\n");
+	printf("  -h	Display this help message\n");
+	printf("  -n N	Number of consumer threads (default: %d)\n", consumers);
+	printf("  -p P	Number of producer threads (default: %d)\n", producers);
+	printf("  -q Q	Buffer depth (default: %d)\n", depth);
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+}
+
+static void cond_lock(struct cond_shared *shared)
+{
+	if (glibc)
+		pthread_mutex_lock(&shared->pmutex);
+	else
+		futex_mutex3_lock(&shared->mutex, FUTEX_PRIVATE_FLAG);
+}
+
+static void cond_unlock(struct cond_shared *shared)
+{
+	if (glibc)
+		pthread_mutex_unlock(&shared->pmutex);
+	else
+		futex_mutex3_unlock(&shared->mutex, FUTEX_PRIVATE_FLAG);
+}
+
+static void cond_wait(struct cond_shared *shared, struct futex_cond *cond,
+		      pthread_cond_t *pcond)
+{
+	if (glibc)
+		pthread_cond_wait(pcond, &shared->pmutex);
+	else
+		futex_cond_wait(cond, &shared->mutex, FUTEX_PRIVATE_FLAG);
+}
+
+/* Wake the other side, timing the call and counting its syscalls */
+static void cond_wake(struct cond_thread *self, struct futex_cond *cond,
+		      pthread_cond_t *pcond)
+{
+	struct cond_shared *shared = self->shared;
+	long syscalls = locktest_syscalls;
+	u_int64_t start = harness_now();
+
+	if (glibc && broadcast)
+		pthread_cond_broadcast(pcond);
+	else if (glibc)
+		pthread_cond_signal(pcond);
+	else if (broadcast)
+		futex_cond_broadcast(cond, &shared->mutex, FUTEX_PRIVATE_FLAG);
+	else
+		futex_cond_signal(cond, FUTEX_PRIVATE_FLAG);
+	hist_add(&self->signal, harness_now() - start);
+	self->syscalls += locktest_syscalls - syscalls;
+	self->signals++;
+}
+
+static void *producer_thread(void *arg)
+{
+	struct cond_thread *self = arg;
+	struct cond_shared *shared = self->shared;
+
+	if (barrier_sync(&shared->barrier_before) <= 0)
+		return NULL;
+
+	while (1) {
+		cond_lock(shared);
+		while (shared->items >= depth && !shared->stop) {
+			cond_wait(shared, &shared->not_full,
+				  &shared->pnot_full);
+			self->wakeups++;
+			if (shared->items >= depth && !shared->stop)
+				self->spurious++;
+		}
+		if (shared->stop) {
+			cond_unlock(shared);
+			break;
+		}
+		shared->items++;
+		shared->produced++;
+		cond_unlock(shared);
+		self->ops++;
+		cond_wake(self, &shared->not_empty, &shared->pnot_empty);
+	}
+	barrier_sync(&shared->barrier_after);
+	return NULL;
+}
+
+static void *consumer_thread(void *arg)
+{
+	struct cond_thread *self = arg;
+	struct cond_shared *shared = self->shared;
+
+	if (barrier_sync(&shared->barrier_before) <= 0)
+		return NULL;
+
+	while (1) {
+		cond_lock(shared);
+		while (!shared->items && !shared->stop) {
+			cond_wait(shared, &shared->not_empty,
+				  &shared->pnot_empty);
+			self->wakeups++;
+			if (!shared->items && !shared->stop)
+				self->spurious++;
+		}
+		if (shared->stop) {
+			cond_unlock(shared);
+			break;
+		}
+		shared->items--;
+		shared->consumed++;
+		cond_unlock(shared);
+		self->ops++;
+		cond_wake(self, &shared->not_full, &shared->pnot_full);
+	}
+	barrier_sync(&shared->barrier_after);
+	return NULL;
+}
+
+/* Stop every thread, waiting or not, and wait for all to be through */
+static void stop_threads(struct cond_shared *shared)
+{
+	cond_lock(shared);
+	shared->stop = 1;
+	cond_unlock(shared);
+	while (shared->barrier_after.threads > 0) {
+		if (glibc) {
+			pthread_cond_broadcast(&shared->pnot_empty);
+			pthread_cond_broadcast(&shared->pnot_full);
+		} else {
+			futex_cond_broadcast(&shared->not_empty, &shared->mutex,
+					     FUTEX_PRIVATE_FLAG);
+			futex_cond_broadcast(&shared->not_full, &shared->mutex,
+					     FUTEX_PRIVATE_FLAG);
+		}
+		usleep(1000);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct cond_shared shared;
+	struct cond_thread *tdata;
+	struct histogram wakes;
+	long ops = 0, wakeups = 0, spurious = 0, signals = 0, syscalls = 0;
+	u_int64_t before, after;
+	pthread_t *thread;
+	int threads, i, c;
+
+	while ((c = getopt(argc, argv, "bcd:ghn:p:q:v:")) != -1) {
+		switch(c) {
+		case 'b':
+			broadcast = 1;
+			break;
+		case 'c':
+			log_color(1);
+			break;
+		case 'd':
+			duration = parse_duration(optarg);
+			if (duration <= 0) {
+				usage(basename(argv[0]));
+				exit(1);
+			}
+			break;
+		case 'g':
+			glibc = 1;
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'n':
+			consumers = atoi(optarg);
+			break;
+		case 'p':
+			producers = atoi(optarg);
+			break;
+		case 'q':
+			depth = atoi(optarg);
+			break;
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	printf("%s: Measure %s %s cost\n", basename(argv[0]),
+	       glibc ? "pthread_cond" : "futex_cond",
+	       broadcast ? "broadcast" : "signal");
+	printf("\tArguments: producers=%d consumers=%d depth=%d "
+	       "duration=%.3fs\n", producers, consumers, depth, duration / 1e9);
+
+	threads = producers + consumers;
+	tdata = calloc(threads, sizeof(*tdata));
+	thread = calloc(threads, sizeof(*thread));
+	if (!tdata || !thread || producers < 1 || consumers < 1 || depth < 1) {
+		error("need producers, consumers and a buffer\n", errno);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+
+	memset(&shared, 0, sizeof(shared));
+	pthread_mutex_init(&shared.pmutex, NULL);
+	pthread_cond_init(&shared.pnot_empty, NULL);
+	pthread_cond_init(&shared.pnot_full, NULL);
+	barrier_init(&shared.barrier_before, threads);
+	barrier_init(&shared.barrier_after, threads);
+
+	for (i = 0; i < threads; i++) {
+		tdata[i].shared = &shared;
+		tdata[i].producer = i < producers;
+		hist_init(&tdata[i].signal);
+		if (pthread_create(thread + i, NULL, tdata[i].producer ?
+				   producer_thread : consumer_thread,
+				   tdata + i)) {
+			error("pthread_create\n", errno);
+			/* Could not create thread; abort */
+			barrier_unblock(&shared.barrier_before, -1);
+			while (--i >= 0)
+				pthread_join(thread[i], NULL);
+			free(thread);
+			free(tdata);
+			print_result(RET_ERROR);
+			return RET_ERROR;
+		}
+	}
+	barrier_wait(&shared.barrier_before);
+	before = harness_now();
+	barrier_unblock(&shared.barrier_before, 1);
+	harness_sleep(duration);
+	stop_threads(&shared);
+	after = harness_now();
+	barrier_unblock(&shared.barrier_after, 1);
+
+	hist_init(&wakes);
+	for (i = 0; i < threads; i++) {
+		pthread_join(thread[i], NULL);
+		if (tdata[i].producer)
+			ops += tdata[i].ops;
+		wakeups += tdata[i].wakeups;
+		spurious += tdata[i].spurious;
+		signals += tdata[i].signals;
+		syscalls += tdata[i].syscalls;
+		hist_merge(&wakes, &tdata[i].signal);
+	}
+
+	if (shared.produced - shared.consumed != shared.items ||
+	    shared.produced != ops) {
+		error("produced %ld, consumed %ld, %ld left in the buffer\n", 0,
+		      shared.produced, shared.consumed, shared.items);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+
+	hist_print(broadcast ? "Broadcast" : "Signal", &wakes);
+	if (!glibc)
+		printf("\tSyscalls: %.3f per %s\n",
+		       signals ? (double)syscalls / signals : 0.,
+		       broadcast ? "broadcast" : "signal");
+	printf("\tWakeups: %ld, %.2f%% spurious\n", wakeups,
+	       wakeups ? spurious * 100.0 / wakeups : 0.);
+	printf("Result: %.0f Kitems/s\n",
+	       shared.consumed * 1e6 / (after - before));
+
+	free(thread);
+	free(tdata);
+	return RET_PASS;
+}
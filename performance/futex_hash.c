@@ -0,0 +1,211 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      futex_hash.c
+ *
+ * DESCRIPTION
+ *      Expose contention in the kernel futex hash buckets. Threads spread
+ *      FUTEX_WAIT calls with a mismatched value across K distinct futex
+ *      words, each call hashing the address and taking the bucket lock before
+ *      returning EWOULDBLOCK. No two threads share a futex word once K is at
+ *      least the number of threads, so any loss of throughput as K varies
+ *      comes from unrelated futexes colliding in the same hash bucket. The
+ *      stride and alignment of the words are configurable to vary which
+ *      buckets they hash to.
+ *
+ *****************************************************************************/
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "futextest.h"
+#include "logging.h"
+#include "harness.h"
+
+static int threads = 16;
+static int iterations = 1000000;
+static int max_futexes = 65536;
+static int stride = 4;
+static int align = 0;
+
+struct hash_shared {
+	struct thread_barrier barrier_before;
+	struct thread_barrier barrier_after;
+	char *base;
+	int futexes;
+	int loops;
+};
+
+struct hash_thread {
+	struct hash_shared *shared;
+	int id;
+};
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -a A	Byte offset of the first futex from a page boundary "
+	       "(default: %d)\n", align);
+	printf("  -c	Use color\n");
+	printf("  -h	Display this help message\n");
+	printf("  -i I	Number of iterations per futex count (default: %d)\n",
+	       iterations);
+	printf("  -k K	Largest number of futexes (default: %d)\n",
+	       max_futexes);
+	printf("  -n N	Number of threads (default: %d)\n", threads);
+	printf("  -s S	Distance between futexes in bytes (default: %d)\n",
+	       stride);
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+}
+
+static void *hash_thread(void *arg)
+{
+	struct hash_thread *self = arg;
+	struct hash_shared *shared = self->shared;
+	int loops = shared->loops;
+	int idx = self->id % shared->futexes;
+	futex_t *futex;
+
+	if (barrier_sync(&shared->barrier_before) <= 0)
+		return NULL;
+	while (loops--) {
+		futex = (futex_t *)(shared->base + (long)idx * stride);
+		futex_wait(futex, 1, NULL, FUTEX_PRIVATE_FLAG);
+		idx = (idx + threads) % shared->futexes;
+	}
+	barrier_sync(&shared->barrier_after);
+	return NULL;
+}
+
+/* Run one timed pass over the given number of futexes, return Kiter/s */
+static double hash_test(struct hash_shared *shared, int futexes)
+{
+	struct hash_thread tdata[threads];
+	pthread_t thread[threads];
+	u_int64_t before, after;
+	int i;
+
+	barrier_init(&shared->barrier_before, threads);
+	barrier_init(&shared->barrier_after, threads);
+	shared->futexes = futexes;
+	shared->loops = iterations / threads;
+
+	for (i = 0; i < threads; i++) {
+		tdata[i].shared = shared;
+		tdata[i].id = i;
+		if (pthread_create(thread + i, NULL, hash_thread, tdata + i)) {
+			error("pthread_create\n", errno);
+			/* Could not create thread; abort */
+			barrier_unblock(&shared->barrier_before, -1);
+			while (--i >= 0)
+				pthread_join(thread[i], NULL);
+			return -1;
+		}
+	}
+	barrier_wait(&shared->barrier_before);
+	before = harness_now();
+	barrier_unblock(&shared->barrier_before, 1);
+	barrier_wait(&shared->barrier_after);
+	after = harness_now();
+	barrier_unblock(&shared->barrier_after, 1);
+	for (i = 0; i < threads; i++)
+		pthread_join(thread[i], NULL);
+
+	return (double)threads * shared->loops * 1000000 / (after - before);
+}
+
+int main(int argc, char *argv[])
+{
+	struct hash_shared shared;
+	double kiter = 0;
+	void *mem;
+	int futexes, ret, c;
+
+	while ((c = getopt(argc, argv, "a:chi:k:n:s:v:")) != -1) {
+		switch(c) {
+		case 'a':
+			align = atoi(optarg);
+			break;
+		case 'c':
+			log_color(1);
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		case 'k':
+			max_futexes = atoi(optarg);
+			break;
+		case 'n':
+			threads = atoi(optarg);
+			break;
+		case 's':
+			stride = atoi(optarg);
+			break;
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	printf("%s: Measure futex hash-bucket contention across futex counts\n",
+	       basename(argv[0]));
+	printf("\tArguments: iterations=%d threads=%d futexes=1-%d stride=%dB "
+	       "align=%dB\n", iterations, threads, max_futexes, stride, align);
+
+	if (stride <= 0 || stride % (int)sizeof(futex_t) ||
+	    align < 0 || align % (int)sizeof(futex_t) || max_futexes < 1) {
+		error("stride must be a positive and align a non-negative "
+		      "multiple of %zu bytes, and futexes at least 1\n", 0,
+		      sizeof(futex_t));
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+
+	ret = posix_memalign(&mem, sysconf(_SC_PAGESIZE),
+			     align + (size_t)max_futexes * stride);
+	if (ret) {
+		error("posix_memalign\n", ret);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+	memset(mem, 0, align + (size_t)max_futexes * stride);
+	shared.base = (char *)mem + align;
+
+	for (futexes = 1; futexes <= max_futexes; futexes *= 2) {
+		kiter = hash_test(&shared, futexes);
+		if (kiter < 0) {
+			free(mem);
+			print_result(RET_ERROR);
+			return RET_ERROR;
+		}
+		printf("\tfutexes=%d: %.0f Kiter/s\n", futexes, kiter);
+	}
+	free(mem);
+
+	/* Report the most spread out configuration */
+	printf("Result: %.0f Kiter/s\n", kiter);
+
+	return RET_PASS;
+}
@@ -0,0 +1,111 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      futex_lock_pi.c
+ *
+ * DESCRIPTION
+ *      Measure FUTEX_LOCK_PI/FUTEX_UNLOCK_PI mutex operations per second over
+ *      a configurable number of iterations and threads. The uncontended path
+ *      is a TID cmpxchg in user space, as with a PTHREAD_PRIO_INHERIT mutex.
+ *      Results are directly comparable to futex_wait run with the same
+ *      arguments.
+ *
+ *****************************************************************************/
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "futextest.h"
+#include "logging.h"
+#include "harness.h"
+
+
+static int threads = 256;
+static int iterations = 100000000;
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -c	Use color\n");
+	printf("  -h	Display this help message\n");
+	printf("  -i I	Number of iterations (default: %d)\n", iterations);
+	printf("  -n N	Number of threads (default: %d)\n", threads);
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+	locktest_usage();
+}
+
+static __thread pid_t tid;
+
+static void pi_lock(futex_t *futex)
+{
+	if (!tid)
+		tid = syscall(SYS_gettid);
+	if (futex_pi_lock(futex, tid, harness_flags)) {
+		error("futex_lock_pi\n", errno);
+		locktest_abort();
+	}
+}
+
+static void pi_unlock(futex_t *futex)
+{
+	if (futex_pi_unlock(futex, tid, harness_flags)) {
+		error("futex_unlock_pi\n", errno);
+		locktest_abort();
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int ret, c;
+	while ((c = getopt(argc, argv, "chi:n:v:" LOCKTEST_GETOPT)) != -1) {
+		switch(c) {
+		case 'c':
+			log_color(1);
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		case 'n':
+			threads = atoi(optarg);
+			break;
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			if (locktest_getopt(c, optarg))
+				break;
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	printf("%s: Measure FUTEX_LOCK_PI operations per second\n",
+	       basename(argv[0]));
+	printf("\tArguments: iterations=%d threads=%d", iterations, threads);
+	locktest_print_args();
+
+	/* run the test and display the results */
+	ret = locktest(pi_lock, pi_unlock, iterations, threads);
+
+	return ret;
+}
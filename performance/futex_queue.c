@@ -0,0 +1,242 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      futex_queue.c
+ *
+ * DESCRIPTION
+ *      Producers and consumers passing timestamps through the futex_queue.h
+ *      bounded queue, a work queue parking on its futex_sem semaphores when
+ *      empty or full. Producers push for the test duration, then consumers
+ *      drain the queue up to one end marker each. The items moved per
+ *      second, the latency from push to pop and the futex syscalls made per
+ *      item are reported.
+ *
+ *****************************************************************************/
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "futextest.h"
+#include "logging.h"
+#include "harness.h"
+#include "futex_queue.h"
+
+/* Popped by a consumer to tell it to exit */
+#define QUEUE_END 0
+
+static int producers = 4;
+static int consumers = 4;
+static int depth = 64;
+static int work = 0;
+static long long duration = 5000000000LL;
+
+struct queue_shared {
+	struct thread_barrier barrier;
+	struct futex_queue queue;
+	volatile int stop;
+};
+
+struct queue_thread {
+	struct queue_shared *shared;
+	long items;
+	long syscalls;
+	struct histogram latency;
+};
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -c	Use color\n");
+	printf("  -d D	Run for duration D (default: 5s)\n");
+	printf("  -h	Display this help message\n");
+	printf("  -n N	Number of consumer threads (default: %d)\n", consumers);
+	printf("  -p P	Number of producer threads (default: %d)\n", producers);
+	printf("  -q Q	Queue depth, a power of two (default: %d)\n", depth);
+	printf("  -s S	Spin S loops per item consumed (default: %d)\n", work);
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+}
+
+static void *producer_thread(void *arg)
+{
+	struct queue_thread *self = arg;
+	struct queue_shared *shared = self->shared;
+
+	if (barrier_sync(&shared->barrier) <= 0)
+		return NULL;
+
+	while (!shared->stop) {
+		futex_queue_push(&shared->queue, harness_now(),
+				 FUTEX_PRIVATE_FLAG);
+		self->items++;
+	}
+	self->syscalls = locktest_syscalls;
+	return NULL;
+}
+
+static void *consumer_thread(void *arg)
+{
+	struct queue_thread *self = arg;
+	struct queue_shared *shared = self->shared;
+	u_int64_t stamp;
+
+	if (barrier_sync(&shared->barrier) <= 0)
+		return NULL;
+
+	while ((stamp = futex_queue_pop(&shared->queue,
+					FUTEX_PRIVATE_FLAG)) != QUEUE_END) {
+		hist_add(&self->latency, harness_now() - stamp);
+		locktest_spin(work);
+		self->items++;
+	}
+	self->syscalls = locktest_syscalls;
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct queue_shared shared;
+	struct queue_thread *tdata;
+	struct futex_queue_slot *ring;
+	struct histogram latency;
+	long pushed = 0, popped = 0, syscalls = 0;
+	u_int64_t before, after;
+	pthread_t *thread;
+	int threads, i, c;
+
+	while ((c = getopt(argc, argv, "cd:hn:p:q:s:v:")) != -1) {
+		switch(c) {
+		case 'c':
+			log_color(1);
+			break;
+		case 'd':
+			duration = parse_duration(optarg);
+			if (duration <= 0) {
+				usage(basename(argv[0]));
+				exit(1);
+			}
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'n':
+			consumers = atoi(optarg);
+			break;
+		case 'p':
+			producers = atoi(optarg);
+			break;
+		case 'q':
+			depth = atoi(optarg);
+			break;
+		case 's':
+			work = atoi(optarg);
+			break;
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	printf("%s: Measure bounded futex queue throughput\n",
+	       basename(argv[0]));
+	printf("\tArguments: producers=%d consumers=%d depth=%d work=%d "
+	       "duration=%.3fs\n", producers, consumers, depth, work,
+	       duration / 1e9);
+
+	if (producers < 1 || consumers < 1 || depth < 1 ||
+	    (depth & (depth - 1))) {
+		error("need producers, consumers and a power of two depth\n", 0);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+
+	threads = producers + consumers;
+	tdata = calloc(threads, sizeof(*tdata));
+	thread = calloc(threads, sizeof(*thread));
+	ring = calloc(depth, sizeof(*ring));
+	if (!tdata || !thread || !ring) {
+		error("calloc\n", errno);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+
+	memset(&shared, 0, sizeof(shared));
+	futex_queue_init(&shared.queue, ring, depth);
+	barrier_init(&shared.barrier, threads);
+	for (i = 0; i < threads; i++) {
+		tdata[i].shared = &shared;
+		hist_init(&tdata[i].latency);
+		if (pthread_create(thread + i, NULL, i < producers ?
+				   producer_thread : consumer_thread,
+				   tdata + i)) {
+			error("pthread_create\n", errno);
+			/* Could not create thread; abort */
+			barrier_unblock(&shared.barrier, -1);
+			while (--i >= 0)
+				pthread_join(thread[i], NULL);
+			free(ring);
+			free(thread);
+			free(tdata);
+			print_result(RET_ERROR);
+			return RET_ERROR;
+		}
+	}
+	barrier_wait(&shared.barrier);
+	before = harness_now();
+	barrier_unblock(&shared.barrier, 1);
+	harness_sleep(duration);
+
+	/* Producers finish their last push while consumers still drain */
+	shared.stop = 1;
+	for (i = 0; i < producers; i++)
+		pthread_join(thread[i], NULL);
+	for (i = producers; i < threads; i++)
+		futex_queue_push(&shared.queue, QUEUE_END, FUTEX_PRIVATE_FLAG);
+	for (i = producers; i < threads; i++)
+		pthread_join(thread[i], NULL);
+	after = harness_now();
+
+	hist_init(&latency);
+	for (i = 0; i < threads; i++) {
+		if (i < producers)
+			pushed += tdata[i].items;
+		else
+			popped += tdata[i].items;
+		syscalls += tdata[i].syscalls;
+		hist_merge(&latency, &tdata[i].latency);
+	}
+
+	if (pushed != popped) {
+		error("pushed %ld items but popped %ld\n", 0, pushed, popped);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+
+	hist_print("Push to pop", &latency);
+	printf("\tSyscalls: %.3f per item\n",
+	       popped ? (double)syscalls / popped : 0.);
+	printf("Result: %.0f Kitems/s\n", popped * 1e6 / (after - before));
+
+	free(ring);
+	free(thread);
+	free(tdata);
+	return RET_PASS;
+}
@@ -0,0 +1,232 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      futex_requeue.c
+ *
+ * DESCRIPTION
+ *      Measure the thundering herd cost of a condition variable broadcast.
+ *      N waiters block on a condvar futex and are released by one of:
+ *      o FUTEX_CMP_REQUEUE waking one waiter and moving the rest onto the
+ *        mutex futex, so each unlock hands off to the next waiter (default)
+ *      o FUTEX_WAKE of all waiters, which then race to reacquire the
+ *        mutex (-w)
+ *      The time from the broadcast until the last waiter has acquired and
+ *      released the mutex is reported, along with the context switches
+ *      incurred per broadcast.
+ *
+ *****************************************************************************/
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include "atomic.h"
+#include "futextest.h"
+#include "logging.h"
+#include "harness.h"
+
+/* Time for registered waiters to get from the counter into the kernel */
+#define SETTLE_US 100
+
+static int threads = 256;
+static int rounds = 100;
+static int wake_all = 0;
+
+struct requeue_shared {
+	struct thread_barrier barrier;
+	futex_t cond;
+	futex_t mutex;
+	futex_t done;
+	atomic_t waiting;
+	atomic_t passed;
+	volatile int stop;
+	volatile u_int64_t last;
+};
+
+static struct requeue_shared shared;
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -c	Use color\n");
+	printf("  -h	Display this help message\n");
+	printf("  -i I	Number of broadcasts (default: %d)\n", rounds);
+	printf("  -n N	Number of waiting threads (default: %d)\n", threads);
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+	printf("  -w	Broadcast with FUTEX_WAKE instead of FUTEX_CMP_REQUEUE\n");
+}
+
+static void *waiter_thread(void *arg)
+{
+	futex_t seq;
+
+	if (barrier_sync(&shared.barrier) <= 0)
+		return NULL;
+
+	while (1) {
+		futex_mutex2_lock(&shared.mutex, FUTEX_PRIVATE_FLAG);
+		seq = shared.cond;
+		atomic_inc(&shared.waiting);
+		futex_mutex2_unlock(&shared.mutex, FUTEX_PRIVATE_FLAG);
+
+		while (shared.cond == seq)
+			futex_wait(&shared.cond, seq, NULL, FUTEX_PRIVATE_FLAG);
+		if (shared.stop)
+			break;
+
+		/*
+		 * Waiters coming out of a requeue broadcast must leave the
+		 * mutex marked contended, as the other requeued waiters are
+		 * already blocked on it and rely on the unlock to wake them.
+		 */
+		if (wake_all)
+			futex_mutex2_lock(&shared.mutex, FUTEX_PRIVATE_FLAG);
+		else
+			futex_mutex_lock_contended(&shared.mutex,
+						   FUTEX_PRIVATE_FLAG);
+		if (atomic_inc(&shared.passed) == threads) {
+			shared.last = harness_now();
+			shared.done = 1;
+			futex_wake(&shared.done, 1, FUTEX_PRIVATE_FLAG);
+		}
+		futex_mutex2_unlock(&shared.mutex, FUTEX_PRIVATE_FLAG);
+	}
+	return NULL;
+}
+
+static void wait_registered(void)
+{
+	while (shared.waiting.val < threads)
+		usleep(SETTLE_US);
+	usleep(SETTLE_US);
+}
+
+static long context_switches(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_nvcsw + ru.ru_nivcsw;
+}
+
+int main(int argc, char *argv[])
+{
+	struct histogram through;
+	u_int64_t start, total = 0;
+	long csw = 0, before;
+	pthread_t *thread;
+	futex_t seq;
+	int i, r, ret, c;
+
+	while ((c = getopt(argc, argv, "chi:n:v:w")) != -1) {
+		switch(c) {
+		case 'c':
+			log_color(1);
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'i':
+			rounds = atoi(optarg);
+			break;
+		case 'n':
+			threads = atoi(optarg);
+			break;
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		case 'w':
+			wake_all = 1;
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	printf("%s: Measure condvar broadcast herd cost with %s\n",
+	       basename(argv[0]), wake_all ? "FUTEX_WAKE" : "FUTEX_CMP_REQUEUE");
+	printf("\tArguments: rounds=%d threads=%d wake_all=%d\n",
+	       rounds, threads, wake_all);
+
+	thread = calloc(threads, sizeof(*thread));
+	if (!thread) {
+		error("calloc\n", errno);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+
+	barrier_init(&shared.barrier, threads);
+	for (i = 0; i < threads; i++) {
+		if (pthread_create(thread + i, NULL, waiter_thread, NULL)) {
+			error("pthread_create\n", errno);
+			/* Could not create thread; abort */
+			barrier_unblock(&shared.barrier, -1);
+			while (--i >= 0)
+				pthread_join(thread[i], NULL);
+			print_result(RET_ERROR);
+			return RET_ERROR;
+		}
+	}
+	barrier_wait(&shared.barrier);
+	barrier_unblock(&shared.barrier, 1);
+
+	hist_init(&through);
+	for (r = 0; r < rounds; r++) {
+		wait_registered();
+		atomic_set(&shared.waiting, 0);
+		atomic_set(&shared.passed, 0);
+		shared.done = 0;
+
+		before = context_switches();
+		start = harness_now();
+		seq = futex_inc(&shared.cond);
+		if (wake_all)
+			ret = futex_wake(&shared.cond, INT_MAX,
+					 FUTEX_PRIVATE_FLAG);
+		else
+			ret = futex_cmp_requeue(&shared.cond, seq,
+						&shared.mutex, 1, INT_MAX,
+						FUTEX_PRIVATE_FLAG);
+		if (ret < 0)
+			error("broadcast\n", errno);
+		while (!shared.done)
+			futex_wait(&shared.done, 0, NULL, FUTEX_PRIVATE_FLAG);
+		csw += context_switches() - before;
+
+		hist_add(&through, shared.last - start);
+		total += shared.last - start;
+	}
+
+	/* Release the waiters for good */
+	wait_registered();
+	shared.stop = 1;
+	futex_inc(&shared.cond);
+	futex_wake(&shared.cond, INT_MAX, FUTEX_PRIVATE_FLAG);
+	for (i = 0; i < threads; i++)
+		pthread_join(thread[i], NULL);
+	free(thread);
+
+	hist_print("Last waiter through", &through);
+	printf("\tContext switches: %.1f per broadcast\n",
+	       rounds ? (double)csw / rounds : 0.);
+	printf("Result: %.1f us\n", rounds ? total / 1000.0 / rounds : 0.);
+
+	return RET_PASS;
+}
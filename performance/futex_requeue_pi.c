@@ -0,0 +1,298 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      futex_requeue_pi.c
+ *
+ * DESCRIPTION
+ *      Measure the throughput of a PI aware condition variable under load.
+ *      N waiters loop on futex_wait_requeue_pi() while a waker continuously
+ *      signals (or broadcasts, -b) with futex_cmp_requeue_pi(). Each round
+ *      trip lasts from the signal until every task it woke or requeued has
+ *      been through the PI mutex. The wake latency is measured from the
+ *      signal until the waiter owns the mutex. With -r the same cycle runs
+ *      on plain FUTEX_WAIT/FUTEX_CMP_REQUEUE and a non-PI mutex for
+ *      comparison.
+ *
+ *****************************************************************************/
+
+#include <errno.h>
+#include <getopt.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "atomic.h"
+#include "futextest.h"
+#include "logging.h"
+#include "harness.h"
+
+static int threads = 16;
+static int rounds = 10000;
+static int broadcast = 0;
+static int plain = 0;
+
+struct requeue_shared {
+	struct thread_barrier barrier;
+	futex_t cond;
+	futex_t mutex;
+	atomic_t passed;
+	atomic_t exited;
+	volatile int stop;
+	volatile int failed;	/* the PI mutex could not be taken or released */
+	volatile u_int64_t stamp;
+};
+
+struct requeue_thread {
+	struct requeue_shared *shared;
+	struct histogram wake;
+};
+
+static __thread pid_t tid;
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -b	Broadcast wakeup (all waiters)\n");
+	printf("  -c	Use color\n");
+	printf("  -h	Display this help message\n");
+	printf("  -i I	Number of round trips (default: %d)\n", rounds);
+	printf("  -n N	Number of waiting threads (default: %d)\n", threads);
+	printf("  -r	Use plain FUTEX_CMP_REQUEUE and a non-PI mutex\n");
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+}
+
+/*
+ * Wait on the condvar, return with the mutex held and 1 if woken by a signal,
+ * 0 if not, or -1 without the mutex if the PI mutex could not be taken.
+ */
+static inline int cond_wait(struct requeue_shared *shared, futex_t seq)
+{
+	int ret;
+
+	if (plain) {
+		ret = futex_wait(&shared->cond, seq, NULL, FUTEX_PRIVATE_FLAG);
+		/* Keep the mutex contended so requeued waiters are not lost */
+		futex_mutex_lock_contended(&shared->mutex, FUTEX_PRIVATE_FLAG);
+		return ret == 0;
+	}
+	ret = futex_wait_requeue_pi(&shared->cond, seq, &shared->mutex, NULL,
+				    FUTEX_PRIVATE_FLAG);
+	if (ret == 0)
+		return 1;
+	/* The condvar moved on before we blocked, take the mutex ourselves */
+	if (futex_pi_lock(&shared->mutex, tid, FUTEX_PRIVATE_FLAG)) {
+		error("futex_lock_pi\n", errno);
+		return -1;
+	}
+	return 0;
+}
+
+static inline int cond_unlock(struct requeue_shared *shared)
+{
+	if (plain) {
+		futex_mutex2_unlock(&shared->mutex, FUTEX_PRIVATE_FLAG);
+		return 0;
+	}
+	if (futex_pi_unlock(&shared->mutex, tid, FUTEX_PRIVATE_FLAG)) {
+		error("futex_unlock_pi\n", errno);
+		return -1;
+	}
+	return 0;
+}
+
+/* Signal or broadcast, return the number of tasks woken or requeued */
+static inline int cond_signal(struct requeue_shared *shared, int nr_requeue)
+{
+	futex_t seq = futex_inc(&shared->cond);
+
+	if (plain)
+		return futex_cmp_requeue(&shared->cond, seq, &shared->mutex, 1,
+					 nr_requeue, FUTEX_PRIVATE_FLAG);
+	return futex_cmp_requeue_pi(&shared->cond, seq, &shared->mutex, 1,
+				    nr_requeue, FUTEX_PRIVATE_FLAG);
+}
+
+static void *waiter_thread(void *arg)
+{
+	struct requeue_thread *self = arg;
+	struct requeue_shared *shared = self->shared;
+	u_int64_t now;
+	futex_t seq;
+	int woken;
+
+	tid = syscall(SYS_gettid);
+	if (barrier_sync(&shared->barrier) <= 0)
+		return NULL;
+
+	while (1) {
+		/* Read seq before stop so the final broadcast cannot be missed */
+		seq = shared->cond;
+		if (shared->stop)
+			break;
+		woken = cond_wait(shared, seq);
+		now = harness_now();
+		if (woken < 0) {
+			shared->failed = 1;
+			break;
+		}
+		/*
+		 * Only count waiters the signal woke or requeued, main() waits
+		 * for that many before moving the stamp to the next round.
+		 * Those finding the condvar moved on just go around again.
+		 */
+		if (woken && !shared->stop) {
+			hist_add(&self->wake, now - shared->stamp);
+			atomic_inc(&shared->passed);
+		}
+		if (cond_unlock(shared)) {
+			/* Still owning the mutex the others were requeued to */
+			shared->failed = 1;
+			break;
+		}
+	}
+	atomic_inc(&shared->exited);
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct requeue_shared shared;
+	struct requeue_thread *tdata;
+	struct histogram wake;
+	u_int64_t start, elapsed;
+	int nr_requeue, target, misses = 0;
+	pthread_t *thread;
+	int i, r, ret = 0, c;
+
+	while ((c = getopt(argc, argv, "bchi:n:rv:")) != -1) {
+		switch(c) {
+		case 'b':
+			broadcast = 1;
+			break;
+		case 'c':
+			log_color(1);
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'i':
+			rounds = atoi(optarg);
+			break;
+		case 'n':
+			threads = atoi(optarg);
+			break;
+		case 'r':
+			plain = 1;
+			break;
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	printf("%s: Measure %s condvar round trips per second\n",
+	       basename(argv[0]), plain ? "FUTEX_CMP_REQUEUE" :
+	       "FUTEX_CMP_REQUEUE_PI");
+	printf("\tArguments: rounds=%d threads=%d broadcast=%d plain=%d\n",
+	       rounds, threads, broadcast, plain);
+
+	tdata = calloc(threads, sizeof(*tdata));
+	thread = calloc(threads, sizeof(*thread));
+	if (!tdata || !thread) {
+		error("calloc\n", errno);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+
+	memset(&shared, 0, sizeof(shared));
+	barrier_init(&shared.barrier, threads);
+	for (i = 0; i < threads; i++) {
+		tdata[i].shared = &shared;
+		hist_init(&tdata[i].wake);
+		if (pthread_create(thread + i, NULL, waiter_thread, tdata + i)) {
+			error("pthread_create\n", errno);
+			/* Could not create thread; abort */
+			barrier_unblock(&shared.barrier, -1);
+			while (--i >= 0)
+				pthread_join(thread[i], NULL);
+			free(thread);
+			free(tdata);
+			print_result(RET_ERROR);
+			return RET_ERROR;
+		}
+	}
+	barrier_wait(&shared.barrier);
+	barrier_unblock(&shared.barrier, 1);
+
+	nr_requeue = broadcast ? INT_MAX : 0;
+	start = harness_now();
+	for (r = 0; r < rounds && !shared.failed; ) {
+		target = shared.passed.val;
+		shared.stamp = harness_now();
+		ret = cond_signal(&shared, nr_requeue);
+		if (ret < 0) {
+			error("cond_signal\n", errno);
+			break;
+		}
+		if (ret == 0) {
+			/* Nobody blocked on the condvar yet */
+			misses++;
+			sched_yield();
+			continue;
+		}
+		target += ret;
+		while (shared.passed.val < target && !shared.failed)
+			sched_yield();
+		r++;
+	}
+	elapsed = harness_now() - start;
+
+	/* Release the waiters for good */
+	shared.stop = 1;
+	while (shared.exited.val < threads && !shared.failed) {
+		cond_signal(&shared, INT_MAX);
+		sched_yield();
+	}
+	if (shared.failed) {
+		/* Waiters on the broken mutex go away with the process */
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+	hist_init(&wake);
+	for (i = 0; i < threads; i++) {
+		pthread_join(thread[i], NULL);
+		hist_merge(&wake, &tdata[i].wake);
+	}
+	free(thread);
+	free(tdata);
+
+	if (ret < 0) {
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+
+	info("%d signals found no waiters\n", misses);
+	hist_print("Wake", &wake);
+	printf("Result: %.0f round-trips/s\n",
+	       elapsed ? r * 1000000000.0 / elapsed : 0.);
+
+	return RET_PASS;
+}
@@ -0,0 +1,322 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      futex_rwlock.c
+ *
+ * DESCRIPTION
+ *      Measure reader and writer throughput of the futex_rwlock.h lock, which
+ *      parks both classes on one futex word with different bitsets, against
+ *      a two futex design parking readers and writers on separate sequence
+ *      futexes (-t). Each thread takes the lock for reading with the given
+ *      probability and for writing otherwise, holding it for a short spin.
+ *      Writers bump a counter on entry and exit, so readers seeing it odd,
+ *      or a final count not matching the writes, exposes a broken lock.
+ *
+ *****************************************************************************/
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "futextest.h"
+#include "futex_rwlock.h"
+#include "logging.h"
+#include "harness.h"
+
+static int threads = 16;
+static int read_pct = 90;
+static int hold = 100;
+static int two_futex = 0;
+static long long duration = 5000000000LL;
+
+struct rwlock_shared {
+	struct thread_barrier barrier_before;
+	struct thread_barrier barrier_after;
+	volatile int stop;
+	struct futex_rwlock rw __attribute__((aligned(64)));
+	/* Sequence futexes of the two futex design */
+	futex_t read_seq;
+	futex_t write_seq;
+	volatile long data __attribute__((aligned(64)));
+};
+
+struct rwlock_thread {
+	struct rwlock_shared *shared;
+	int id;
+	long reads;
+	long writes;
+	long torn;		/* odd data seen under a read lock */
+	struct histogram read_wait;
+	struct histogram write_wait;
+};
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -c	Use color\n");
+	printf("  -d D	Run for duration D (default: 5s)\n");
+	printf("  -h	Display this help message\n");
+	printf("  -n N	Number of threads (default: %d)\n", threads);
+	printf("  -r R	Percentage of read acquisitions (default: %d)\n",
+	       read_pct);
+	printf("  -s S	Spin S loops inside the critical section "
+	       "(default: %d)\n", hold);
+	printf("  -t	Use the two futex rwlock instead of futex_rwlock.h\n");
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+}
+
+/*
+ * The two futex design keeps the lock word and waiter counts of
+ * futex_rwlock.h, but readers and writers sleep on their own sequence
+ * futexes, each bumped before it is woken.
+ */
+static inline void seq_wake(futex_t *seq, int nr_wake)
+{
+	futex_inc(seq);
+	futex_wake(seq, nr_wake, FUTEX_PRIVATE_FLAG);
+}
+
+static void rdlock2(struct rwlock_shared *shared)
+{
+	struct futex_rwlock *rw = &shared->rw;
+	u_int32_t val, seq;
+
+	while (1) {
+		val = rw->lock;
+		if (!(val & FUTEX_RWLOCK_WRITER) && !rw->writers_waiting) {
+			if (futex_cmpxchg(&rw->lock, val, val + 1) == val)
+				return;
+			continue;
+		}
+		seq = shared->read_seq;
+		futex_inc(&rw->readers_waiting);
+		val = rw->lock;
+		if ((val & FUTEX_RWLOCK_WRITER) || rw->writers_waiting)
+			futex_wait(&shared->read_seq, seq, NULL,
+				   FUTEX_PRIVATE_FLAG);
+		futex_dec(&rw->readers_waiting);
+	}
+}
+
+static void rdunlock2(struct rwlock_shared *shared)
+{
+	struct futex_rwlock *rw = &shared->rw;
+
+	if (futex_dec(&rw->lock) == 0 && rw->writers_waiting)
+		seq_wake(&shared->write_seq, 1);
+}
+
+static void wrlock2(struct rwlock_shared *shared)
+{
+	struct futex_rwlock *rw = &shared->rw;
+	u_int32_t seq;
+
+	while (futex_cmpxchg(&rw->lock, 0, FUTEX_RWLOCK_WRITER) != 0) {
+		seq = shared->write_seq;
+		futex_inc(&rw->writers_waiting);
+		if (rw->lock != 0)
+			futex_wait(&shared->write_seq, seq, NULL,
+				   FUTEX_PRIVATE_FLAG);
+		futex_dec(&rw->writers_waiting);
+	}
+}
+
+static void wrunlock2(struct rwlock_shared *shared)
+{
+	struct futex_rwlock *rw = &shared->rw;
+
+	futex_xchg(&rw->lock, 0);
+	if (rw->writers_waiting)
+		seq_wake(&shared->write_seq, 1);
+	else if (rw->readers_waiting)
+		seq_wake(&shared->read_seq, INT_MAX);
+}
+
+static void *rwlock_thread(void *arg)
+{
+	struct rwlock_thread *self = arg;
+	struct rwlock_shared *shared = self->shared;
+	u_int32_t seed = self->id * 2654435761u + 1;
+	u_int64_t start;
+
+	if (barrier_sync(&shared->barrier_before) <= 0)
+		return NULL;
+
+	while (!shared->stop) {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		start = harness_now();
+		if (seed % 100 < read_pct) {
+			if (two_futex)
+				rdlock2(shared);
+			else
+				futex_rwlock_rdlock(&shared->rw,
+						    FUTEX_PRIVATE_FLAG);
+			hist_add(&self->read_wait, harness_now() - start);
+			if (shared->data & 1)
+				self->torn++;
+			locktest_spin(hold);
+			if (two_futex)
+				rdunlock2(shared);
+			else
+				futex_rwlock_rdunlock(&shared->rw,
+						      FUTEX_PRIVATE_FLAG);
+			self->reads++;
+		} else {
+			if (two_futex)
+				wrlock2(shared);
+			else
+				futex_rwlock_wrlock(&shared->rw,
+						    FUTEX_PRIVATE_FLAG);
+			hist_add(&self->write_wait, harness_now() - start);
+			shared->data++;
+			locktest_spin(hold);
+			shared->data++;
+			if (two_futex)
+				wrunlock2(shared);
+			else
+				futex_rwlock_wrunlock(&shared->rw,
+						      FUTEX_PRIVATE_FLAG);
+			self->writes++;
+		}
+	}
+	barrier_sync(&shared->barrier_after);
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct rwlock_shared *shared;
+	struct rwlock_thread *tdata;
+	struct histogram read_wait, write_wait;
+	long reads = 0, writes = 0, torn = 0;
+	u_int64_t before, after;
+	pthread_t *thread;
+	int i, c;
+
+	while ((c = getopt(argc, argv, "cd:hn:r:s:tv:")) != -1) {
+		switch(c) {
+		case 'c':
+			log_color(1);
+			break;
+		case 'd':
+			duration = parse_duration(optarg);
+			if (duration <= 0) {
+				usage(basename(argv[0]));
+				exit(1);
+			}
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'n':
+			threads = atoi(optarg);
+			break;
+		case 'r':
+			read_pct = atoi(optarg);
+			break;
+		case 's':
+			hold = atoi(optarg);
+			break;
+		case 't':
+			two_futex = 1;
+			break;
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	printf("%s: Measure %s rwlock throughput\n", basename(argv[0]),
+	       two_futex ? "two futex" : "FUTEX_WAIT_BITSET");
+	printf("\tArguments: threads=%d read=%d%% hold=%d duration=%.3fs\n",
+	       threads, read_pct, hold, duration / 1e9);
+
+	tdata = calloc(threads, sizeof(*tdata));
+	thread = calloc(threads, sizeof(*thread));
+	if (!tdata || !thread ||
+	    posix_memalign((void **)&shared, 64, sizeof(*shared))) {
+		error("allocating thread data\n", errno);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+	memset(shared, 0, sizeof(*shared));
+	barrier_init(&shared->barrier_before, threads);
+	barrier_init(&shared->barrier_after, threads);
+
+	for (i = 0; i < threads; i++) {
+		tdata[i].shared = shared;
+		tdata[i].id = i;
+		hist_init(&tdata[i].read_wait);
+		hist_init(&tdata[i].write_wait);
+		if (pthread_create(thread + i, NULL, rwlock_thread, tdata + i)) {
+			error("pthread_create\n", errno);
+			/* Could not create thread; abort */
+			barrier_unblock(&shared->barrier_before, -1);
+			while (--i >= 0)
+				pthread_join(thread[i], NULL);
+			free(thread);
+			free(tdata);
+			free(shared);
+			print_result(RET_ERROR);
+			return RET_ERROR;
+		}
+	}
+	barrier_wait(&shared->barrier_before);
+	before = harness_now();
+	barrier_unblock(&shared->barrier_before, 1);
+	harness_sleep(duration);
+	shared->stop = 1;
+	barrier_wait(&shared->barrier_after);
+	after = harness_now();
+	barrier_unblock(&shared->barrier_after, 1);
+
+	hist_init(&read_wait);
+	hist_init(&write_wait);
+	for (i = 0; i < threads; i++) {
+		pthread_join(thread[i], NULL);
+		reads += tdata[i].reads;
+		writes += tdata[i].writes;
+		torn += tdata[i].torn;
+		hist_merge(&read_wait, &tdata[i].read_wait);
+		hist_merge(&write_wait, &tdata[i].write_wait);
+	}
+
+	if (torn || shared->data != 2 * writes) {
+		error("readers saw %ld partial writes, %ld of %ld writes "
+		      "counted\n", 0, torn, shared->data / 2, writes);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+
+	printf("\tReaders: %.0f Kops/s\n", reads * 1e6 / (after - before));
+	printf("\tWriters: %.0f Kops/s\n", writes * 1e6 / (after - before));
+	hist_print("Read wait", &read_wait);
+	hist_print("Write wait", &write_wait);
+	printf("Result: %.0f Kops/s\n",
+	       (reads + writes) * 1e6 / (after - before));
+
+	free(thread);
+	free(tdata);
+	free(shared);
+	return RET_PASS;
+}
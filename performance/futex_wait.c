@@ -22,7 +22,9 @@
  *
  * DESCRIPTION
  *      Measure FUTEX_WAIT operations per second over a configurable number
- *      of iterations and treads.
+ *      of iterations and treads. With -z the cmpxchg mutex uses a futex2
+ *      word of 8, 16, 32 or 64 bits and sys_futex_wait/sys_futex_wake
+ *      instead of the 32 bit futex() syscall.
  *
  * AUTHOR
  *      Michel Lespinasse <walken@google.com>
@@ -46,16 +48,30 @@
 
 static int threads = 256;
 static int iterations = 100000000;
+static int mutex = 0;
+static int spins = -1;
+static int word = -1;		/* FUTEX2_SIZE_*, or -1 for futex() */
+static unsigned int word_flags;
+static char lock_name[32];
+
+static const char *words[] = { "u8", "u16", "u32", "u64" };
 
 void usage(char *prog)
 {
 	printf("Usage: %s\n", prog);
+	printf("  -b B	Spin budget of the adaptive and mcs mutexes in pause "
+	       "instructions, or auto (default: auto)\n");
 	printf("  -c	Use color\n");
 	printf("  -h	Display this help message\n");
 	printf("  -i I	Number of iterations (default: %d)\n", iterations);
+	printf("  -m M	Mutex: cmpxchg, drepper1, drepper2, drepper3, ticket, "
+	       "adaptive or mcs (default: cmpxchg)\n");
 	printf("  -n N	Number of threads (default: %d)\n", threads);
 	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
 	       VQUIET, VCRITICAL, VINFO);
+	printf("  -z Z	Futex2 word of the cmpxchg mutex: u8, u16, u32 or u64 "
+	       "(default: futex() syscall)\n");
+	locktest_usage();
 }
 
 static inline void futex_wait_lock(futex_t *futex)
@@ -67,7 +83,8 @@ static inline void futex_wait_lock(futex_t *futex)
 		if (status == 1)
 			status = futex_cmpxchg(futex, 1, 2);
 		if (status != 0) {
-			futex_wait(futex, 2, NULL, FUTEX_PRIVATE_FLAG);
+			futex_mutex_syscall();
+			futex_wait(futex, 2, NULL, harness_flags);
 			status = *futex;
 		}
 		if (status == 0)
@@ -82,23 +99,135 @@ static inline void futex_cmpxchg_unlock(futex_t *futex)
 		status = futex_cmpxchg(futex, 1, 0);
 	if (status == 2) {
 		futex_cmpxchg(futex, 2, 0);
-		futex_wake(futex, 1, FUTEX_PRIVATE_FLAG);
+		futex_mutex_syscall();
+		futex_wake(futex, 1, harness_flags);
 	}
 }
 
-static void futex_wait_test(futex_t *futex, int loops)
+/*
+ * The cmpxchg mutex on a futex2 word of the size selected with -z. It uses
+ * locktest_word, which is typed and aligned for every size, instead of the
+ * 32 bit harness word.
+ */
+static void futex2_wait_lock(futex_t *futex)
 {
-	while (loops--) {
-		futex_wait_lock(futex);
-		futex_cmpxchg_unlock(futex);
+	futex64_t *word = locktest_word;
+	u_int64_t status = futex2_get(word, word_flags);
+	if (status == 0)
+		status = futex2_cmpxchg(word, 0, 1, word_flags);
+	while (status != 0) {
+		if (status == 1)
+			status = futex2_cmpxchg(word, 1, 2, word_flags);
+		if (status != 0) {
+			futex_mutex_syscall();
+			futex2_wait(word, 2, futex2_mask(word_flags),
+				    word_flags, NULL, CLOCK_MONOTONIC);
+			status = futex2_get(word, word_flags);
+		}
+		if (status == 0)
+			status = futex2_cmpxchg(word, 0, 2, word_flags);
 	}
 }
 
+static void futex2_cmpxchg_unlock(futex_t *futex)
+{
+	futex64_t *word = locktest_word;
+	u_int64_t status = futex2_get(word, word_flags);
+	if (status == 1)
+		status = futex2_cmpxchg(word, 1, 0, word_flags);
+	if (status == 2) {
+		futex2_cmpxchg(word, 2, 0, word_flags);
+		futex_mutex_syscall();
+		futex2_wake(word, futex2_mask(word_flags), 1, word_flags);
+	}
+}
+
+static void mutex1_lock(futex_t *futex)
+{
+	futex_mutex1_lock(futex, harness_flags);
+}
+
+static void mutex1_unlock(futex_t *futex)
+{
+	futex_mutex1_unlock(futex, harness_flags);
+}
+
+static void mutex2_lock(futex_t *futex)
+{
+	futex_mutex2_lock(futex, harness_flags);
+}
+
+static void mutex2_unlock(futex_t *futex)
+{
+	futex_mutex2_unlock(futex, harness_flags);
+}
+
+static void mutex3_lock(futex_t *futex)
+{
+	futex_mutex3_lock(futex, harness_flags);
+}
+
+static void mutex3_unlock(futex_t *futex)
+{
+	futex_mutex3_unlock(futex, harness_flags);
+}
+
+static void ticket_lock(futex_t *futex)
+{
+	futex_ticket_lock(futex, harness_flags);
+}
+
+static void ticket_unlock(futex_t *futex)
+{
+	futex_ticket_unlock(futex, harness_flags);
+}
+
+static void adaptive_lock(futex_t *futex)
+{
+	futex_adaptive_lock(futex, futex + LOCKTEST_LINE_WORDS, spins,
+			    harness_flags);
+}
+
+static void adaptive_unlock(futex_t *futex)
+{
+	futex_adaptive_unlock(futex, harness_flags);
+}
+
+static void mcs_lock(futex_t *futex)
+{
+	futex_mcs_lock(futex, locktest_nodes, locktest_id, spins,
+		       harness_flags);
+}
+
+static void mcs_unlock(futex_t *futex)
+{
+	futex_mcs_unlock(futex, locktest_nodes, locktest_id, harness_flags);
+}
+
+static struct {
+	const char *name;
+	void (*lock)(futex_t *futex);
+	void (*unlock)(futex_t *futex);
+} mutexes[] = {
+	{ "cmpxchg", futex_wait_lock, futex_cmpxchg_unlock },
+	{ "drepper1", mutex1_lock, mutex1_unlock },
+	{ "drepper2", mutex2_lock, mutex2_unlock },
+	{ "drepper3", mutex3_lock, mutex3_unlock },
+	{ "ticket", ticket_lock, ticket_unlock },
+	{ "adaptive", adaptive_lock, adaptive_unlock },
+	{ "mcs", mcs_lock, mcs_unlock },
+};
+#define NR_MUTEXES (sizeof(mutexes) / sizeof(mutexes[0]))
+
 int main(int argc, char *argv[])
 {
+	futex64_t probe = 0;
 	int ret, c;
-	while ((c = getopt(argc, argv, "chi:n:v:")) != -1) {
+	while ((c = getopt(argc, argv, "b:chi:m:n:v:z:" LOCKTEST_GETOPT)) != -1) {
 		switch(c) {
+		case 'b':
+			spins = strcmp(optarg, "auto") ? atoi(optarg) : -1;
+			break;
 		case 'c':
 			log_color(1);
 			break;
@@ -108,13 +237,33 @@ int main(int argc, char *argv[])
 		case 'i':
 			iterations = atoi(optarg);
 			break;
+		case 'm':
+			for (mutex = 0; mutex < NR_MUTEXES; mutex++)
+				if (!strcmp(optarg, mutexes[mutex].name))
+					break;
+			if (mutex == NR_MUTEXES) {
+				usage(basename(argv[0]));
+				exit(1);
+			}
+			break;
 		case 'n':
 			threads = atoi(optarg);
 			break;
 		case 'v':
 			log_verbosity(atoi(optarg));
 			break;
+		case 'z':
+			for (word = 0; word < 4; word++)
+				if (!strcmp(optarg, words[word]))
+					break;
+			if (word == 4) {
+				usage(basename(argv[0]));
+				exit(1);
+			}
+			break;
 		default:
+			if (locktest_getopt(c, optarg))
+				break;
 			usage(basename(argv[0]));
 			exit(1);
 		}
@@ -122,10 +271,46 @@ int main(int argc, char *argv[])
 
 	printf("%s: Measure FUTEX_WAIT operations per second\n",
 	       basename(argv[0]));
-	printf("\tArguments: iterations=%d threads=%d\n", iterations, threads);
+	if (word >= 0 && mutexes[mutex].lock != futex_wait_lock) {
+		error("-z only applies to the cmpxchg mutex\n", 0);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+	if (word >= 0)
+		snprintf(lock_name, sizeof(lock_name), "%s:%s",
+			 mutexes[mutex].name, words[word]);
+	else if (mutexes[mutex].lock != adaptive_lock &&
+		 mutexes[mutex].lock != mcs_lock)
+		snprintf(lock_name, sizeof(lock_name), "%s",
+			 mutexes[mutex].name);
+	else if (spins < 0)
+		snprintf(lock_name, sizeof(lock_name), "%s:auto",
+			 mutexes[mutex].name);
+	else
+		snprintf(lock_name, sizeof(lock_name), "%s:%d",
+			 mutexes[mutex].name, spins);
+	printf("\tArguments: iterations=%d threads=%d mutex=%s", iterations,
+	       threads, lock_name);
+	locktest_print_args();
+
+	if (word >= 0) {
+		word_flags = word |
+			(harness_flags & FUTEX_PRIVATE_FLAG ? FUTEX2_PRIVATE : 0);
+		/* Fails with EINVAL if the kernel lacks this word size */
+		if (futex2_wake(&probe, futex2_mask(word_flags), 1,
+				word_flags) < 0) {
+			error("futex2 %s word\n", errno, words[word]);
+			print_result(RET_ERROR);
+			return RET_ERROR;
+		}
+		mutexes[mutex].lock = futex2_wait_lock;
+		mutexes[mutex].unlock = futex2_cmpxchg_unlock;
+	}
 
 	/* run the test and display the results */
-	ret = locktest(futex_wait_test, iterations, threads);
+	locktest_lock = lock_name;
+	ret = locktest(mutexes[mutex].lock, mutexes[mutex].unlock, iterations,
+		       threads);
 
 	return ret;
 }
@@ -0,0 +1,348 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      futex_waitv.c
+ *
+ * DESCRIPTION
+ *      Measure one thread waiting for events from M sources, each source
+ *      owning a futex word, using one of:
+ *      o futex_waitv() on all M words, which returns the source (default)
+ *      o one shared bitset futex word every source ORs its bit into, the
+ *        waiter exchanging it with 0 to learn the sources, and checking
+ *        per source pending flags when there are more than 32 sources
+ *        (-m bitset)
+ *      o a helper thread per source blocked on its word, forwarding events
+ *        through a shared futex word (-m thread)
+ *      Each round one source posts an event and waits for the waiter to
+ *      acknowledge it. The latency from the post until the waiter has
+ *      identified the source and the CPU time per event are reported.
+ *
+ *****************************************************************************/
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "futextest.h"
+#include "logging.h"
+#include "harness.h"
+
+#define MODE_WAITV	0
+#define MODE_BITSET	1
+#define MODE_THREAD	2
+
+static const char *modes[] = { "waitv", "bitset", "thread" };
+
+static int sources = 8;
+static int rounds = 10000;
+static int mode = MODE_WAITV;
+
+struct source {
+	futex_t futex;		/* bumped by every event of the source */
+	futex_t pending;	/* set until the waiter has seen the event */
+} __attribute__((aligned(64)));
+
+struct waitv_shared {
+	struct thread_barrier barrier;
+	struct source source[FUTEX_WAITV_MAX];
+	futex_t events __attribute__((aligned(64)));
+	futex_t ack;
+	volatile int expected;
+	volatile u_int64_t stamp;
+	volatile int stop;
+	volatile int failed;
+	long mismatched;
+	struct histogram latency;
+};
+
+static struct waitv_shared shared;
+
+struct helper {
+	int id;
+};
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -c	Use color\n");
+	printf("  -h	Display this help message\n");
+	printf("  -i I	Number of events (default: %d)\n", rounds);
+	printf("  -m M	Wait: waitv, bitset or thread (default: waitv)\n");
+	printf("  -n N	Number of sources, up to %d (default: %d)\n",
+	       FUTEX_WAITV_MAX, sources);
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+}
+
+/* Record the event from source s and let the poster continue */
+static void handle_event(int s)
+{
+	hist_add(&shared.latency, harness_now() - shared.stamp);
+	if (s != shared.expected)
+		shared.mismatched++;
+	futex_inc(&shared.ack);
+	futex_wake(&shared.ack, 1, FUTEX_PRIVATE_FLAG);
+}
+
+static void waitv_loop(void)
+{
+	struct futex_waitv w[FUTEX_WAITV_MAX];
+	int i, s;
+
+	for (i = 0; i < sources; i++)
+		futex_waitv_set(&w[i], &shared.source[i].futex,
+				shared.source[i].futex, FUTEX_PRIVATE_FLAG);
+	if (barrier_sync(&shared.barrier) <= 0)
+		return;
+	while (!shared.stop) {
+		s = futex_waitv(w, sources, NULL, CLOCK_MONOTONIC);
+		if (s < 0) {
+			if (errno != EAGAIN && errno != EINTR) {
+				error("futex_waitv\n", errno);
+				/* Release the poster waiting for an ack */
+				shared.failed = 1;
+				futex_inc(&shared.ack);
+				futex_wake(&shared.ack, 1, FUTEX_PRIVATE_FLAG);
+				return;
+			}
+			/* A source moved before we blocked */
+			for (s = 0; s < sources; s++)
+				if (shared.source[s].futex != w[s].val)
+					break;
+			if (s == sources)
+				continue;
+		}
+		w[s].val = shared.source[s].futex;
+		if (!shared.stop)
+			handle_event(s);
+	}
+}
+
+/* Wait on the shared bitset word, learning the sources from its bits */
+static void bitset_loop(void)
+{
+	u_int32_t bits;
+	int b, s;
+
+	if (barrier_sync(&shared.barrier) <= 0)
+		return;
+	while (!shared.stop) {
+		bits = futex_xchg(&shared.events, 0);
+		if (!bits) {
+			futex_wait(&shared.events, 0, NULL, FUTEX_PRIVATE_FLAG);
+			continue;
+		}
+		for (b = 0; b < 32; b++) {
+			if (!(bits & (1U << b)))
+				continue;
+			/* Sources b, b + 32, ... share bit b */
+			for (s = b; s < sources; s += 32) {
+				if (sources > 32 &&
+				    (!shared.source[s].pending ||
+				     !futex_xchg(&shared.source[s].pending, 0)))
+					continue;
+				if (!shared.stop)
+					handle_event(s);
+			}
+		}
+	}
+}
+
+/* Wait on the shared events word, finding the sources by their flags */
+static void events_loop(void)
+{
+	u_int32_t val;
+	int s, found;
+
+	if (barrier_sync(&shared.barrier) <= 0)
+		return;
+	while (!shared.stop) {
+		val = shared.events;
+		found = 0;
+		for (s = 0; s < sources; s++) {
+			if (!shared.source[s].pending ||
+			    !futex_xchg(&shared.source[s].pending, 0))
+				continue;
+			found = 1;
+			if (!shared.stop)
+				handle_event(s);
+		}
+		if (found)
+			continue;
+		futex_wait(&shared.events, val, NULL, FUTEX_PRIVATE_FLAG);
+	}
+}
+
+static void *waiter_thread(void *arg)
+{
+	if (mode == MODE_WAITV)
+		waitv_loop();
+	else if (mode == MODE_BITSET)
+		bitset_loop();
+	else
+		events_loop();
+	return NULL;
+}
+
+/* Forward the events of one source to the shared events word */
+static void *helper_thread(void *arg)
+{
+	struct source *src = &shared.source[((struct helper *)arg)->id];
+	u_int32_t val = src->futex;
+
+	if (barrier_sync(&shared.barrier) <= 0)
+		return NULL;
+	while (!shared.stop) {
+		futex_wait(&src->futex, val, NULL, FUTEX_PRIVATE_FLAG);
+		if (src->futex == val)
+			continue;
+		val = src->futex;
+		src->pending = 1;
+		futex_inc(&shared.events);
+		futex_wake(&shared.events, 1, FUTEX_PRIVATE_FLAG);
+	}
+	return NULL;
+}
+
+static void post_event(int s)
+{
+	struct source *src = &shared.source[s];
+
+	if (mode == MODE_BITSET) {
+		if (sources > 32)
+			src->pending = 1;
+		/* The waiter only blocks on an empty word */
+		if (!futex_or(&shared.events, 1U << (s % 32)))
+			futex_wake(&shared.events, 1, FUTEX_PRIVATE_FLAG);
+	} else {
+		futex_inc(&src->futex);
+		futex_wake(&src->futex, 1, FUTEX_PRIVATE_FLAG);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct helper helper[FUTEX_WAITV_MAX + 1];
+	pthread_t thread[FUTEX_WAITV_MAX + 1];
+	u_int64_t user0, system0, user, system;
+	u_int32_t ack;
+	int nr_threads, i, r, c;
+
+	while ((c = getopt(argc, argv, "chi:m:n:v:")) != -1) {
+		switch(c) {
+		case 'c':
+			log_color(1);
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'i':
+			rounds = atoi(optarg);
+			break;
+		case 'm':
+			for (mode = 0; mode < 3; mode++)
+				if (!strcmp(optarg, modes[mode]))
+					break;
+			if (mode == 3) {
+				usage(basename(argv[0]));
+				exit(1);
+			}
+			break;
+		case 'n':
+			sources = atoi(optarg);
+			break;
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	printf("%s: Measure waiting on several sources with %s\n",
+	       basename(argv[0]), modes[mode]);
+	printf("\tArguments: rounds=%d sources=%d\n", rounds, sources);
+
+	if (sources < 1 || sources > FUTEX_WAITV_MAX) {
+		error("sources must be between 1 and %d\n", 0,
+		      FUTEX_WAITV_MAX);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+	hist_init(&shared.latency);
+
+	nr_threads = 1 + (mode == MODE_THREAD ? sources : 0);
+	barrier_init(&shared.barrier, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		helper[i].id = i - 1;
+		if (pthread_create(thread + i, NULL, i ? helper_thread :
+				   waiter_thread, helper + i)) {
+			error("pthread_create\n", errno);
+			/* Could not create thread; abort */
+			barrier_unblock(&shared.barrier, -1);
+			while (--i >= 0)
+				pthread_join(thread[i], NULL);
+			print_result(RET_ERROR);
+			return RET_ERROR;
+		}
+	}
+	barrier_wait(&shared.barrier);
+	barrier_unblock(&shared.barrier, 1);
+
+	harness_cputime(&user0, &system0);
+	for (r = 0; r < rounds && !shared.failed; r++) {
+		ack = shared.ack;
+		shared.expected = r % sources;
+		shared.stamp = harness_now();
+		post_event(r % sources);
+		while (shared.ack == ack && !shared.failed)
+			futex_wait(&shared.ack, ack, NULL, FUTEX_PRIVATE_FLAG);
+	}
+	harness_cputime(&user, &system);
+
+	/* Release the waiter and helpers for good */
+	shared.stop = 1;
+	futex_inc(&shared.events);
+	futex_wake(&shared.events, 1, FUTEX_PRIVATE_FLAG);
+	for (i = 0; i < sources; i++) {
+		futex_inc(&shared.source[i].futex);
+		futex_wake(&shared.source[i].futex, 1, FUTEX_PRIVATE_FLAG);
+	}
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(thread[i], NULL);
+
+	if (shared.failed) {
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+	if (shared.mismatched) {
+		error("%ld events reported from the wrong source\n", 0,
+		      shared.mismatched);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+
+	hist_print("Post to wakeup", &shared.latency);
+	printf("\tCPU: %.0fns user, %.0fns system per event\n",
+	       rounds ? (double)(user - user0) / rounds : 0.,
+	       rounds ? (double)(system - system0) / rounds : 0.);
+	printf("Result: %.0f ns\n", rounds ?
+	       (double)(user - user0 + system - system0) / rounds : 0.);
+
+	return RET_PASS;
+}
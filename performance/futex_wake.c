@@ -0,0 +1,304 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      futex_wake.c
+ *
+ * DESCRIPTION
+ *      Measure the cost of the FUTEX_WAKE syscall and the latency from the
+ *      wakeup until the woken thread runs. N waiters are parked on a single
+ *      futex and woken nr_wake at a time, for nr_wake = 1, 2, 4, ... N. The
+ *      waker publishes a timestamp in shared memory immediately before each
+ *      FUTEX_WAKE, which the woken threads use to compute wake-to-run time.
+ *      With -z the futex is a futex2 word of 8, 16, 32 or 64 bits, waited
+ *      on and woken with sys_futex_wait and sys_futex_wake.
+ *
+ *****************************************************************************/
+
+#include <getopt.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "atomic.h"
+#include "futextest.h"
+#include "logging.h"
+#include "harness.h"
+
+/* Time for re-parked waiters to get from the counter into the kernel */
+#define SETTLE_US 50
+
+static int threads = 256;
+static int rounds = 1000;
+static long discarded;		/* rounds that found too few sleepers */
+static int word = -1;		/* FUTEX2_SIZE_*, or -1 for futex() */
+static unsigned int word_flags = FUTEX2_SIZE_U32;
+
+static const char *words[] = { "u8", "u16", "u32", "u64" };
+
+struct wake_shared {
+	struct thread_barrier barrier;
+	futex64_t futex;	/* wide enough for every futex2 word */
+	atomic_t parked;
+	atomic_t reported;
+	volatile u_int64_t stamp;
+};
+
+struct wake_thread {
+	struct wake_shared *shared;
+	volatile u_int64_t latency;
+	volatile int ready;
+};
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -c	Use color\n");
+	printf("  -h	Display this help message\n");
+	printf("  -i I	Number of wake rounds per nr_wake value (default: %d)\n",
+	       rounds);
+	printf("  -n N	Number of waiting threads (default: %d)\n", threads);
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+	printf("  -z Z	Futex2 word: u8, u16, u32 or u64 (default: futex() "
+	       "syscall)\n");
+}
+
+static int word_wait(struct wake_shared *shared)
+{
+	if (word < 0)
+		return futex_wait((futex_t *)&shared->futex, 0, NULL,
+				  FUTEX_PRIVATE_FLAG);
+	return futex2_wait(&shared->futex, 0, futex2_mask(word_flags),
+			   word_flags, NULL, CLOCK_MONOTONIC);
+}
+
+static int word_wake(struct wake_shared *shared, int nr_wake)
+{
+	if (word < 0)
+		return futex_wake((futex_t *)&shared->futex, nr_wake,
+				  FUTEX_PRIVATE_FLAG);
+	return futex2_wake(&shared->futex, futex2_mask(word_flags), nr_wake,
+			   word_flags);
+}
+
+static void *waiter_thread(void *arg)
+{
+	struct wake_thread *self = arg;
+	struct wake_shared *shared = self->shared;
+	u_int64_t now;
+
+	if (barrier_sync(&shared->barrier) <= 0)
+		return NULL;
+
+	atomic_inc(&shared->parked);
+	while (1) {
+		if (word_wait(shared))
+			now = 0;
+		else
+			now = harness_now();
+		if (futex2_get(&shared->futex, word_flags))
+			break;
+		if (!now)
+			continue;	/* EINTR, still parked */
+		atomic_dec(&shared->parked);
+		self->latency = now - shared->stamp;
+		self->ready = 1;
+		atomic_inc(&shared->reported);
+		atomic_inc(&shared->parked);
+	}
+	return NULL;
+}
+
+/* Wait for all waiters to be back on the futex, yielding to let them run */
+static void wait_parked(struct wake_shared *shared)
+{
+	while (shared->parked.val < threads)
+		sched_yield();
+	usleep(SETTLE_US);
+}
+
+/*
+ * Wake nr_wake waiters per round and record syscall and wake-to-run times.
+ * The waiters count themselves parked just before they block, so a round
+ * finding fewer than nr_wake of them asleep is discarded and run again.
+ */
+static u_int64_t wake_rounds(struct wake_shared *shared,
+			     struct wake_thread *tdata, int nr_wake,
+			     struct histogram *syscall,
+			     struct histogram *wakeup, u_int64_t *elapsed)
+{
+	u_int64_t woken = 0, after;
+	int i, r, ret;
+
+	for (r = 0; r < rounds; r++) {
+		wait_parked(shared);
+		atomic_set(&shared->reported, 0);
+		shared->stamp = harness_now();
+		ret = word_wake(shared, nr_wake);
+		after = harness_now();
+		if (ret < 0) {
+			error("futex_wake\n", errno);
+			continue;
+		}
+
+		/* Collect the wake-to-run times left by the woken threads */
+		while (shared->reported.val < ret)
+			sched_yield();
+		for (i = 0; i < threads; i++) {
+			if (!tdata[i].ready)
+				continue;
+			if (ret == nr_wake)
+				hist_add(wakeup, tdata[i].latency);
+			tdata[i].ready = 0;
+		}
+		if (ret < nr_wake) {
+			if (++discarded > rounds)
+				break;
+			r--;
+			continue;
+		}
+		hist_add(syscall, after - shared->stamp);
+		*elapsed += after - shared->stamp;
+		woken += ret;
+	}
+	return woken;
+}
+
+int main(int argc, char *argv[])
+{
+	struct wake_shared shared;
+	struct wake_thread *tdata;
+	struct histogram syscall, wakeup;
+	u_int64_t woken, total_woken = 0, elapsed = 0;
+	pthread_t *thread;
+	char name[32];
+	int nr_wake, i, c;
+
+	while ((c = getopt(argc, argv, "chi:n:v:z:")) != -1) {
+		switch(c) {
+		case 'c':
+			log_color(1);
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'i':
+			rounds = atoi(optarg);
+			break;
+		case 'n':
+			threads = atoi(optarg);
+			break;
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		case 'z':
+			for (word = 0; word < 4; word++)
+				if (!strcmp(optarg, words[word]))
+					break;
+			if (word == 4) {
+				usage(basename(argv[0]));
+				exit(1);
+			}
+			word_flags = word | FUTEX2_PRIVATE;
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	printf("%s: Measure FUTEX_WAKE cost and wake-to-run latency\n",
+	       basename(argv[0]));
+	printf("\tArguments: rounds=%d threads=%d word=%s\n", rounds, threads,
+	       word < 0 ? "legacy" : words[word]);
+
+	/* Fails with EINVAL if the kernel lacks this word size */
+	shared.futex = 0;
+	if (word >= 0 && word_wake(&shared, 1) < 0) {
+		error("futex2 %s word\n", errno, words[word]);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+
+	tdata = calloc(threads, sizeof(*tdata));
+	thread = calloc(threads, sizeof(*thread));
+	if (!tdata || !thread) {
+		error("calloc\n", errno);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+
+	barrier_init(&shared.barrier, threads);
+	atomic_set(&shared.parked, 0);
+	atomic_set(&shared.reported, 0);
+	for (i = 0; i < threads; i++) {
+		tdata[i].shared = &shared;
+		if (pthread_create(thread + i, NULL, waiter_thread, tdata + i)) {
+			error("pthread_create\n", errno);
+			/* Could not create thread; abort */
+			barrier_unblock(&shared.barrier, -1);
+			while (--i >= 0)
+				pthread_join(thread[i], NULL);
+			free(thread);
+			free(tdata);
+			print_result(RET_ERROR);
+			return RET_ERROR;
+		}
+	}
+	barrier_wait(&shared.barrier);
+	barrier_unblock(&shared.barrier, 1);
+
+	/* nr_wake sweeps powers of two up to, and always including, N */
+	for (nr_wake = 1; ; nr_wake = nr_wake * 2 < threads ?
+	     nr_wake * 2 : threads) {
+		hist_init(&syscall);
+		hist_init(&wakeup);
+		woken = wake_rounds(&shared, tdata, nr_wake, &syscall, &wakeup,
+				    &elapsed);
+		total_woken += woken;
+		info("nr_wake=%d: %.2f tasks woken per call\n", nr_wake,
+		     rounds ? (double)woken / rounds : 0.);
+		snprintf(name, sizeof(name), "nr_wake=%d syscall", nr_wake);
+		hist_print(name, &syscall);
+		snprintf(name, sizeof(name), "nr_wake=%d wake-to-run", nr_wake);
+		hist_print(name, &wakeup);
+		if (nr_wake == threads || discarded > rounds)
+			break;
+	}
+
+	/* Release the waiters for good */
+	wait_parked(&shared);
+	futex2_set(&shared.futex, 1, word_flags);
+	word_wake(&shared, INT_MAX);
+	for (i = 0; i < threads; i++)
+		pthread_join(thread[i], NULL);
+	free(thread);
+	free(tdata);
+
+	if (discarded > rounds) {
+		error("over %d rounds found too few waiters asleep\n", 0,
+		      rounds);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+	printf("\tDiscarded: %ld rounds with too few waiters asleep\n",
+	       discarded);
+	printf("Result: %.0f Kwakes/s\n",
+	       elapsed ? total_woken * 1000000.0 / elapsed : 0.);
+
+	return RET_PASS;
+}
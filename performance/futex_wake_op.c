@@ -0,0 +1,198 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      futex_wake_op.c
+ *
+ * DESCRIPTION
+ *      Measure releasing a mutex and signaling a condvar with one
+ *      FUTEX_WAKE_OP, through futex_cond_signal_unlock(), against unlocking
+ *      and signaling with separate FUTEX_WAKE calls (-s). A signaler thread
+ *      repeatedly posts an event under the mutex while N waiters wait for
+ *      events on the condvar. The syscalls per signal and the signal rate
+ *      are reported.
+ *
+ *****************************************************************************/
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "futextest.h"
+#include "logging.h"
+#include "harness.h"
+#include "futex_cond.h"
+
+static int threads = 4;
+static int separate = 0;
+static long long duration = 5000000000LL;
+
+struct wake_op_shared {
+	struct thread_barrier barrier;
+	futex_t mutex;
+	struct futex_cond cond;
+	long events;		/* under the mutex */
+	long wakeups;		/* under the mutex */
+	long signals;
+	long syscalls;		/* made to unlock and signal */
+	volatile int stop;
+};
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -c	Use color\n");
+	printf("  -d D	Run for duration D (default: 5s)\n");
+	printf("  -h	Display this help message\n");
+	printf("  -n N	Number of waiting threads (default: %d)\n", threads);
+	printf("  -s	Unlock and signal with separate FUTEX_WAKE calls\n");
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+}
+
+static void *signal_thread(void *arg)
+{
+	struct wake_op_shared *shared = arg;
+	long syscalls;
+
+	if (barrier_sync(&shared->barrier) <= 0)
+		return NULL;
+
+	while (!shared->stop) {
+		futex_mutex2_lock(&shared->mutex, FUTEX_PRIVATE_FLAG);
+		shared->events++;
+		syscalls = locktest_syscalls;
+		if (separate) {
+			futex_mutex2_unlock(&shared->mutex, FUTEX_PRIVATE_FLAG);
+			futex_cond_signal(&shared->cond, FUTEX_PRIVATE_FLAG);
+		} else {
+			futex_cond_signal_unlock(&shared->cond, &shared->mutex,
+						 FUTEX_PRIVATE_FLAG);
+		}
+		shared->syscalls += locktest_syscalls - syscalls;
+		shared->signals++;
+	}
+	return NULL;
+}
+
+static void *waiter_thread(void *arg)
+{
+	struct wake_op_shared *shared = arg;
+	long seen;
+
+	if (barrier_sync(&shared->barrier) <= 0)
+		return NULL;
+
+	futex_mutex2_lock(&shared->mutex, FUTEX_PRIVATE_FLAG);
+	while (!shared->stop) {
+		seen = shared->events;
+		while (shared->events == seen && !shared->stop)
+			futex_cond_wait(&shared->cond, &shared->mutex,
+					FUTEX_PRIVATE_FLAG);
+		shared->wakeups++;
+	}
+	futex_mutex2_unlock(&shared->mutex, FUTEX_PRIVATE_FLAG);
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct wake_op_shared shared;
+	u_int64_t before, after;
+	pthread_t *thread;
+	int i, c;
+
+	while ((c = getopt(argc, argv, "cd:hn:sv:")) != -1) {
+		switch(c) {
+		case 'c':
+			log_color(1);
+			break;
+		case 'd':
+			duration = parse_duration(optarg);
+			if (duration <= 0) {
+				usage(basename(argv[0]));
+				exit(1);
+			}
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'n':
+			threads = atoi(optarg);
+			break;
+		case 's':
+			separate = 1;
+			break;
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	printf("%s: Measure unlock and signal with %s\n", basename(argv[0]),
+	       separate ? "separate FUTEX_WAKE calls" : "FUTEX_WAKE_OP");
+	printf("\tArguments: threads=%d duration=%.3fs\n", threads,
+	       duration / 1e9);
+
+	thread = calloc(threads + 1, sizeof(*thread));
+	if (!thread) {
+		error("calloc\n", errno);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+
+	memset(&shared, 0, sizeof(shared));
+	barrier_init(&shared.barrier, threads + 1);
+	for (i = 0; i <= threads; i++) {
+		if (pthread_create(thread + i, NULL, i ? waiter_thread :
+				   signal_thread, &shared)) {
+			error("pthread_create\n", errno);
+			/* Could not create thread; abort */
+			barrier_unblock(&shared.barrier, -1);
+			while (--i >= 0)
+				pthread_join(thread[i], NULL);
+			print_result(RET_ERROR);
+			return RET_ERROR;
+		}
+	}
+	barrier_wait(&shared.barrier);
+	before = harness_now();
+	barrier_unblock(&shared.barrier, 1);
+	harness_sleep(duration);
+	/* Under the mutex, so waiters see it or are waiting by the broadcast */
+	futex_mutex2_lock(&shared.mutex, FUTEX_PRIVATE_FLAG);
+	shared.stop = 1;
+	futex_mutex2_unlock(&shared.mutex, FUTEX_PRIVATE_FLAG);
+	pthread_join(thread[0], NULL);
+	after = harness_now();
+
+	futex_cond_broadcast(&shared.cond, &shared.mutex, FUTEX_PRIVATE_FLAG);
+	for (i = 1; i <= threads; i++)
+		pthread_join(thread[i], NULL);
+	free(thread);
+
+	printf("\tSyscalls: %.3f per signal\n",
+	       shared.signals ? (double)shared.syscalls / shared.signals : 0.);
+	printf("\tWakeups: %.3f per signal\n",
+	       shared.signals ? (double)shared.wakeups / shared.signals : 0.);
+	printf("Result: %.0f Ksignals/s\n",
+	       shared.signals * 1e6 / (after - before));
+
+	return RET_PASS;
+}
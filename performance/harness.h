@@ -37,114 +37,722 @@
 #include <errno.h>
 #include <limits.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
-#include <sys/times.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
 #include "logging.h"
+#include "rt_thread.h"
+#include "histogram.h"
+#include "topology.h"
 
+/* Futex syscalls made by the calling worker through futex_mutex.h */
+static __thread long locktest_syscalls;
+
+/* Index of the calling worker, naming its node in locktest_nodes */
+static __thread int locktest_id;
+
+/* Set once the calling worker has called locktest_abort() */
+static __thread int locktest_aborted;
+#define futex_mutex_syscall() (locktest_syscalls++)
+#include "futex_mutex.h"
+#include "futex_barrier.h"
+
+/* Options common to all locktest() based tests, see locktest_getopt() */
+#define LOCKTEST_GETOPT "a:d:fo:p:s:Tw:"
+static char *locktest_affinity = NULL;
+static int locktest_cpus[CPU_SETSIZE];
+static int locktest_ncpus = 0;
+static long long locktest_duration = 0;
+static long long locktest_warmup = 0;
+static int locktest_fork = 0;
+static int locktest_hold = 0;
+static int locktest_prio = 0;
+static int locktest_tsc = 0;
+
+/* One queue node per worker for queue locks, in the shared mapping */
+static struct futex_mcs_node *locktest_nodes;
+
+/* A futex2 word of any size for the lock under test, in the shared mapping */
+static futex64_t *locktest_word;
+
+/* The running locktest, in the mapping shared with worker processes */
+static struct locktest_shared *locktest_current;
+
+/* Name of the lock under test, recorded with the results if set */
+static const char *locktest_lock = NULL;
+
+/* Length of a locktest_ticks() tick in nanoseconds */
+static double locktest_tick_ns = 1.0;
+
+/* opflags for every futex operation issued through the harness */
+static int harness_flags = FUTEX_PRIVATE_FLAG;
 
 struct thread_barrier {
 	futex_t threads;
 	futex_t unblock;
 };
 
+/*
+ * Futex words available to the lock under test, two cache lines so state
+ * written on every acquisition can be kept off the lock word's line
+ */
+#define LOCKTEST_LINE_WORDS 16
+#define LOCKTEST_LOCK_WORDS (2 * LOCKTEST_LINE_WORDS)
+
 struct locktest_shared {
-	struct thread_barrier barrier_before;
-	struct thread_barrier barrier_after;
-	void (* locktest_function)(futex_t *ptr, int loops);
-	int loops;
-	futex_t futex;
+	/* Tree barrier, so starting and stopping many workers stays cheap */
+	struct futex_barrier barrier;
+	void (* lock)(futex_t *ptr);
+	void (* unlock)(futex_t *ptr);
+	long loops;
+	volatile int stop;
+	volatile int failed;	/* see locktest_abort() */
+	/* Keep the contended lock words away from the fields above */
+	futex_t futex[LOCKTEST_LOCK_WORDS] __attribute__((aligned(64)));
+	futex64_t word __attribute__((aligned(64)));	/* see locktest_word */
+};
+
+/*
+ * Per-thread state, allocated by locktest() before the threads are started
+ * so nothing is allocated while the test is running.
+ */
+struct locktest_thread {
+	struct locktest_shared *shared;
+	int id;
+	long iterations;
+	long syscalls;		/* counted by futex_mutex_syscall() */
+	u_int64_t max_gap;	/* longest time between two acquisitions */
+	u_int64_t user;		/* CPU time of the measured loop, with -f */
+	u_int64_t system;
+	struct histogram acquire;
+	struct histogram release;
 };
 
+#if defined(__i386__) || defined(__x86_64__)
+#define HAVE_RDTSC
+static inline u_int64_t rdtsc(void)
+{
+	u_int32_t lo, hi;
+
+	asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((u_int64_t)hi << 32) | lo;
+}
+#endif
+
+/* Monotonic timestamp in nanoseconds */
+static inline u_int64_t harness_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Timestamp for per-operation timing, in units of locktest_tick_ns */
+static inline u_int64_t locktest_ticks(void)
+{
+#ifdef HAVE_RDTSC
+	if (locktest_tsc)
+		return rdtsc();
+#endif
+	return harness_now();
+}
+
+/* Measure the TSC frequency against CLOCK_MONOTONIC */
+static inline void locktest_calibrate(void)
+{
+#ifdef HAVE_RDTSC
+	u_int64_t ns, ticks;
+
+	if (!locktest_tsc)
+		return;
+	ns = harness_now();
+	ticks = rdtsc();
+	usleep(50000);
+	ns = harness_now() - ns;
+	ticks = rdtsc() - ticks;
+	locktest_tick_ns = (double)ns / ticks;
+	info("TSC runs at %.3f GHz\n", 1 / locktest_tick_ns);
+#endif
+}
+
+/**
+ * parse_duration() - parse a time such as "5s", "500ms", "20us" or "2"
+ * @arg:	the string to parse, seconds if there is no unit
+ *
+ * Return the duration in nanoseconds, or -1 if it cannot be parsed.
+ */
+static inline long long parse_duration(const char *arg)
+{
+	char *end;
+	double val = strtod(arg, &end);
+
+	if (end == arg || val < 0)
+		return -1;
+	if (!*end || !strcmp(end, "s"))
+		return val * 1e9;
+	if (!strcmp(end, "ms"))
+		return val * 1e6;
+	if (!strcmp(end, "us"))
+		return val * 1e3;
+	if (!strcmp(end, "ns"))
+		return val;
+	return -1;
+}
+
+/* Sleep for ns nanoseconds */
+static inline void harness_sleep(long long ns)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ns / 1000000000;
+	ts.tv_nsec = ns % 1000000000;
+	while (nanosleep(&ts, &ts) && errno == EINTR)
+		;
+}
+
+/* User and system time of RUSAGE_SELF or RUSAGE_CHILDREN, in ns */
+static inline void harness_rusage(int who, u_int64_t *user, u_int64_t *system)
+{
+	struct rusage usage;
+
+	getrusage(who, &usage);
+	*user = usage.ru_utime.tv_sec * 1000000000ULL +
+		usage.ru_utime.tv_usec * 1000ULL;
+	*system = usage.ru_stime.tv_sec * 1000000000ULL +
+		  usage.ru_stime.tv_usec * 1000ULL;
+}
+
+/* User and system time of this process and its reaped children, in ns */
+static inline void harness_cputime(u_int64_t *user, u_int64_t *system)
+{
+	u_int64_t cuser, csystem;
+
+	harness_rusage(RUSAGE_SELF, user, system);
+	harness_rusage(RUSAGE_CHILDREN, &cuser, &csystem);
+	*user += cuser;
+	*system += csystem;
+}
+
+/**
+ * locktest_usage() - print the usage lines for the LOCKTEST_GETOPT options
+ */
+static inline void locktest_usage(void)
+{
+	printf("  -a A	Bind workers to cpus: compact, scatter, or a list "
+	       "such as 0,2,4-7\n");
+	printf("  -d D	Run for duration D (e.g. 5s, 500ms) instead of a fixed "
+	       "iteration count\n");
+	printf("  -f	Fork processes sharing a MAP_SHARED futex instead of "
+	       "threads\n");
+	printf("  -o O	Output format: text, or one json or csv record per "
+	       "run on stdout (default: text)\n");
+	printf("  -p P	Run threads SCHED_FIFO with priorities spread over "
+	       "1..P (default: off)\n");
+	printf("  -s S	Spin S loops inside the critical section "
+	       "(default: %d)\n", locktest_hold);
+#ifdef HAVE_RDTSC
+	printf("  -T	Time operations with the TSC instead of "
+	       "clock_gettime()\n");
+#endif
+	printf("  -w W	Run unmeasured for W (e.g. 1s) before measuring "
+	       "(default: 0)\n");
+}
+
+/**
+ * locktest_getopt() - parse one of the LOCKTEST_GETOPT options
+ * @c:		the option character returned by getopt()
+ * @arg:	the option argument
+ *
+ * Return 1 if the option was consumed, 0 if it is not a valid locktest option.
+ */
+static inline int locktest_getopt(int c, char *arg)
+{
+	switch (c) {
+	case 'a':
+		locktest_affinity = arg;
+		locktest_ncpus = cpu_map_build(arg, locktest_cpus);
+		return locktest_ncpus > 0;
+	case 'd':
+		locktest_duration = parse_duration(arg);
+		return locktest_duration > 0;
+	case 'f':
+		locktest_fork = 1;
+		harness_flags = 0;
+		return 1;
+	case 'o':
+		return log_output(arg) == 0;
+	case 'p':
+		locktest_prio = atoi(arg);
+		return 1;
+	case 's':
+		locktest_hold = atoi(arg);
+		return 1;
+#ifdef HAVE_RDTSC
+	case 'T':
+		locktest_tsc = 1;
+		return 1;
+#endif
+	case 'w':
+		locktest_warmup = parse_duration(arg);
+		return locktest_warmup >= 0;
+	}
+	return 0;
+}
+
+/**
+ * locktest_print_args() - complete the Arguments line with locktest options
+ */
+static inline void locktest_print_args(void)
+{
+	printf(" hold=%d prio=%d fork=%d", locktest_hold, locktest_prio,
+	       locktest_fork);
+	if (locktest_affinity) {
+		printf(" affinity=%s cpus=", locktest_affinity);
+		cpu_map_print(locktest_cpus, locktest_ncpus);
+	}
+	if (locktest_duration)
+		printf(" duration=%.3fs", locktest_duration / 1e9);
+	printf(" warmup=%.3fs clock=%s\n", locktest_warmup / 1e9,
+	       locktest_tsc ? "tsc" : "monotonic");
+}
+
+/* Busy loop standing in for the work done while holding the lock */
+static inline void locktest_spin(int loops)
+{
+	while (loops--)
+		asm volatile("" ::: "memory");
+}
+
 /* Called by main thread to initialize barrier */
-static void barrier_init(struct thread_barrier *barrier, int threads)
+static inline void barrier_init(struct thread_barrier *barrier, int threads)
 {
 	barrier->threads = threads;
 	barrier->unblock = 0;
 }
 
 /* Called by worker threads to synchronize with main thread */
-static int barrier_sync(struct thread_barrier *barrier)
+static inline int barrier_sync(struct thread_barrier *barrier)
 {
 	futex_dec(&barrier->threads);
 	if (barrier->threads == 0)
-		futex_wake(&barrier->threads, 1, FUTEX_PRIVATE_FLAG);
+		futex_wake(&barrier->threads, 1, harness_flags);
 	while (barrier->unblock == 0)
-		futex_wait(&barrier->unblock, 0, NULL, FUTEX_PRIVATE_FLAG);
+		futex_wait(&barrier->unblock, 0, NULL, harness_flags);
 	return barrier->unblock;
 }
 
 /* Called by main thread to wait for all workers to reach sync point */
-static void barrier_wait(struct thread_barrier *barrier)
+static inline void barrier_wait(struct thread_barrier *barrier)
 {
 	int threads;
 	while ((threads = barrier->threads) > 0)
 		futex_wait(&barrier->threads, threads, NULL,
-			   FUTEX_PRIVATE_FLAG);
+			   harness_flags);
 }
 
 /* Called by main thread to unblock worker threads from their sync point */
-static void barrier_unblock(struct thread_barrier *barrier, int value)
+static inline void barrier_unblock(struct thread_barrier *barrier, int value)
 {
 	barrier->unblock = value;
-	futex_wake(&barrier->unblock, INT_MAX, FUTEX_PRIVATE_FLAG);
+	futex_wake(&barrier->unblock, INT_MAX, harness_flags);
+}
+
+/**
+ * locktest_abort() - end the run after the lock under test failed
+ *
+ * Called by a lock function which returns without the lock, or an unlock
+ * function which could not release it. The calling worker stops before its
+ * critical section. The others release the lock and stop at their next
+ * acquisition, and locktest() returns RET_ERROR.
+ */
+static inline void locktest_abort(void)
+{
+	locktest_aborted = 1;
+	locktest_current->failed = 1;
+	locktest_current->stop = 1;
+}
+
+/*
+ * Run lock/unlock iterations until loops reaches zero (never if negative) or
+ * shared->stop is set. With record set, time each acquire and release into
+ * the thread's histograms, count the iterations and track the longest gap
+ * between two acquisitions, counted from the start for the first one.
+ */
+static inline void locktest_loop(struct locktest_thread *self, long loops,
+				 int record)
+{
+	struct locktest_shared *shared = self->shared;
+	futex_t *futex = shared->futex;
+	u_int64_t start, locked, held, unlocked;
+	u_int64_t prev = locktest_ticks();
+	long syscalls = locktest_syscalls;
+	int hold = locktest_hold;
+
+	while (loops && !shared->stop) {
+		start = locktest_ticks();
+		shared->lock(futex);
+		if (shared->failed) {
+			/* Pass the lock on unless our own lock() failed */
+			if (!locktest_aborted)
+				shared->unlock(futex);
+			break;
+		}
+		held = locked = locktest_ticks();
+		if (hold) {
+			locktest_spin(hold);
+			held = locktest_ticks();
+		}
+		shared->unlock(futex);
+		unlocked = locktest_ticks();
+		if (record) {
+			hist_add(&self->acquire, locked - start);
+			hist_add(&self->release, unlocked - held);
+			if (locked - prev > self->max_gap)
+				self->max_gap = locked - prev;
+			prev = locked;
+			self->iterations++;
+		}
+		if (loops > 0)
+			loops--;
+	}
+	if (record)
+		self->syscalls += locktest_syscalls - syscalls;
 }
 
-static void * locktest_thread(void * dummy)
+static inline void * locktest_thread(void * dummy)
 {
-	struct locktest_shared * shared = dummy;
-	if (barrier_sync(&shared->barrier_before) > 0) {
-		shared->locktest_function(&shared->futex, shared->loops);
-		barrier_sync(&shared->barrier_after);
+	struct locktest_thread * self = dummy;
+	struct locktest_shared * shared = self->shared;
+	u_int64_t user0 = 0, system0 = 0;
+	locktest_id = self->id;
+	if (futex_barrier_sync(&shared->barrier, self->id, harness_flags) <= 0)
+		return NULL;
+	if (locktest_warmup) {
+		locktest_loop(self, -1, 0);
+		if (futex_barrier_sync(&shared->barrier, self->id,
+				       harness_flags) <= 0)
+			return NULL;
 	}
+	/*
+	 * A worker process reports its own CPU time, as the parent only sees
+	 * that of reaped children, warmup included.
+	 */
+	if (locktest_fork)
+		harness_rusage(RUSAGE_SELF, &user0, &system0);
+	locktest_loop(self, locktest_duration ? -1 : shared->loops, 1);
+	if (locktest_fork) {
+		harness_rusage(RUSAGE_SELF, &self->user, &self->system);
+		self->user -= user0;
+		self->system -= system0;
+	}
+	futex_barrier_sync(&shared->barrier, self->id, harness_flags);
 	return NULL;
 }
 
-static int locktest(void locktest_function(futex_t * ptr, int loops),
-		     int iterations, int threads)
+/* Bind worker i to its cpu from the -a placement, if any */
+static inline int locktest_bind(pthread_t thread, pid_t pid, int i)
 {
-	struct locktest_shared shared;
-	pthread_t thread[threads];
+	cpu_set_t cpus;
+	int ret;
+
+	if (!locktest_ncpus)
+		return 0;
+	CPU_ZERO(&cpus);
+	CPU_SET(locktest_cpus[i % locktest_ncpus], &cpus);
+	if (locktest_fork) {
+		if (sched_setaffinity(pid, sizeof(cpus), &cpus)) {
+			error("sched_setaffinity\n", errno);
+			return 1;
+		}
+	} else if ((ret = pthread_setaffinity_np(thread, sizeof(cpus),
+						  &cpus))) {
+		error("pthread_setaffinity_np\n", ret);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Start worker i of a locktest as a thread, or as a process with -f. Return 0
+ * on success, -1 if the worker could not be started, and 1 if it was started
+ * but its scheduling attributes could not be applied.
+ */
+static inline int locktest_spawn(struct locktest_thread *self,
+				 pthread_t *thread, pid_t *pid, int i)
+{
+	struct sched_param schedp;
+	int prio = locktest_prio ? 1 + i % locktest_prio : 0;
+	int ret;
+
+	if (locktest_fork) {
+		if ((*pid = fork()) < 0) {
+			error("fork\n", errno);
+			return -1;
+		}
+		if (*pid == 0) {
+			locktest_thread(self);
+			_exit(0);
+		}
+		if (prio) {
+			memset(&schedp, 0, sizeof(schedp));
+			schedp.sched_priority = prio;
+			if (sched_setscheduler(*pid, SCHED_FIFO, &schedp)) {
+				error("sched_setscheduler\n", errno);
+				return 1;
+			}
+		}
+		return locktest_bind(0, *pid, i);
+	}
+
+	if (prio)
+		ret = create_rt_thread(thread, locktest_thread, self,
+				       SCHED_FIFO, prio);
+	else if ((ret = pthread_create(thread, NULL, locktest_thread, self)))
+		error("pthread_create\n", ret);
+	if (ret)
+		return -1;
+	return locktest_bind(*thread, 0, i);
+}
+
+static inline void locktest_join(pthread_t thread, pid_t pid)
+{
+	if (locktest_fork)
+		waitpid(pid, NULL, 0);
+	else
+		pthread_join(thread, NULL);
+}
+/**
+ * record_hist() - add the percentile summary of a histogram to the record
+ * @name:	field name prefix, e.g. "acquire"
+ * @hist:	the histogram to summarize
+ * @scale:	nanoseconds per recorded unit
+ */
+static inline void record_hist(const char *name, struct histogram *hist,
+			       double scale)
+{
+	static const struct {
+		const char *suffix;
+		double pct;
+	} pcts[] = {
+		{ "p50", 50 }, { "p90", 90 }, { "p99", 99 }, { "p999", 99.9 },
+	};
+	char key[64];
 	int i;
-	clock_t before, after;
-	struct tms tms_before, tms_after;
-	int wall, user, system;
-	double tick;
 
-	barrier_init(&shared.barrier_before, threads);
-	barrier_init(&shared.barrier_after, threads);
-	shared.locktest_function = locktest_function;
-	shared.loops = iterations / threads;
-	shared.futex = 0;
+	for (i = 0; i < sizeof(pcts) / sizeof(pcts[0]); i++) {
+		snprintf(key, sizeof(key), "%s_%s_ns", name, pcts[i].suffix);
+		record_num(key, hist_percentile(hist, pcts[i].pct) * scale);
+	}
+	snprintf(key, sizeof(key), "%s_max_ns", name);
+	record_num(key, hist->max * scale);
+}
 
-	for (i = 0; i < threads; i++)
-		if (pthread_create(thread + i, NULL, locktest_thread,
-					&shared)) {
-			error("pthread_create\n", errno);
-			/* Could not create thread; abort */
-			barrier_unblock(&shared.barrier_before, -1);
+/*
+ * Report how evenly the acquisitions were spread over the workers: Jain's
+ * fairness index (1 when all are equal, 1/threads when one took them all),
+ * the smallest and largest share of the total, and the worst wait and the
+ * longest starvation interval seen by any single worker.
+ */
+static inline void locktest_fairness(struct locktest_thread *tdata,
+				     int threads)
+{
+	double sum = 0, sumsq = 0;
+	long min = LONG_MAX, max = 0;
+	u_int64_t max_wait = 0, max_gap = 0;
+	int i;
+
+	for (i = 0; i < threads; i++) {
+		struct locktest_thread *t = tdata + i;
+
+		info("worker %d: %ld acquisitions, max wait %.0fns, "
+		     "longest gap %.0fns\n", i, t->iterations,
+		     t->acquire.max * locktest_tick_ns,
+		     t->max_gap * locktest_tick_ns);
+		sum += t->iterations;
+		sumsq += (double)t->iterations * t->iterations;
+		if (t->iterations < min)
+			min = t->iterations;
+		if (t->iterations > max)
+			max = t->iterations;
+		if (t->acquire.max > max_wait)
+			max_wait = t->acquire.max;
+		if (t->max_gap > max_gap)
+			max_gap = t->max_gap;
+	}
+	/* Shares are undefined when no iteration completed, recorded as null */
+	if (sum) {
+		printf("\tFairness: jain=%.3f min_share=%.2f%% max_share=%.2f%% "
+		       "fair_share=%.2f%%\n", sum * sum / (threads * sumsq),
+		       100 * min / sum, 100 * max / sum, 100.0 / threads);
+		printf("\tStarvation: max_wait=%.0fns longest_gap=%.0fns\n",
+		       max_wait * locktest_tick_ns, max_gap * locktest_tick_ns);
+	}
+	record_num("jain", sum ? sum * sum / (threads * sumsq) : NAN);
+	record_num("min_share", sum ? min / sum : NAN);
+	record_num("max_share", sum ? max / sum : NAN);
+	record_num("max_wait_ns", max_wait * locktest_tick_ns);
+	record_num("longest_gap_ns", max_gap * locktest_tick_ns);
+}
+
+/* Start the record of a locktest() run with its arguments */
+static inline void locktest_record_args(int iterations, int threads)
+{
+	record_begin();
+	if (locktest_lock)
+		record_str("lock", "%s", locktest_lock);
+	record_num("threads", threads);
+	record_num("iterations", iterations);
+	record_num("duration_s", locktest_duration / 1e9);
+	record_num("warmup_s", locktest_warmup / 1e9);
+	record_num("hold", locktest_hold);
+	record_num("prio", locktest_prio);
+	record_num("fork", locktest_fork);
+	record_str("affinity", "%s", locktest_affinity ? locktest_affinity : "");
+	record_str("clock", "%s", locktest_tsc ? "tsc" : "monotonic");
+}
+
+static inline int locktest(void lock(futex_t * ptr),
+			   void unlock(futex_t * ptr), int iterations,
+			   int threads)
+{
+	struct locktest_shared *shared;
+	struct locktest_thread *tdata;
+	struct histogram acquire, release;
+	pthread_t thread[threads];
+	pid_t pid[threads];
+	u_int64_t before, after, user0, system0, user, system;
+	long total = 0, syscalls = 0;
+	struct futex_barrier_node *barrier_nodes;
+	size_t size, nodes;
+	int i, ret;
+
+	/*
+	 * Everything the workers touch lives in one shared mapping, so the
+	 * same layout serves both threads and forked processes.
+	 */
+	nodes = (sizeof(*shared) + threads * sizeof(*tdata) + 63) & ~63UL;
+	size = nodes + threads * (sizeof(*locktest_nodes) +
+				  sizeof(*barrier_nodes));
+	shared = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shared == MAP_FAILED) {
+		error("mmap\n", errno);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+	tdata = (struct locktest_thread *)(shared + 1);
+	locktest_nodes = (struct futex_mcs_node *)((char *)shared + nodes);
+	barrier_nodes = (struct futex_barrier_node *)(locktest_nodes + threads);
+
+	futex_barrier_init(&shared->barrier, barrier_nodes, threads);
+	shared->lock = lock;
+	shared->unlock = unlock;
+	shared->loops = iterations / threads;
+	shared->stop = 0;
+	shared->failed = 0;
+	memset((void *)shared->futex, 0, sizeof(shared->futex));
+	shared->word = 0;
+	locktest_word = &shared->word;
+	locktest_current = shared;
+
+	for (i = 0; i < threads; i++) {
+		tdata[i].shared = shared;
+		tdata[i].id = i;
+		tdata[i].iterations = 0;
+		tdata[i].syscalls = 0;
+		tdata[i].max_gap = 0;
+		tdata[i].user = 0;
+		tdata[i].system = 0;
+		hist_init(&tdata[i].acquire);
+		hist_init(&tdata[i].release);
+	}
+	locktest_calibrate();
+
+	fflush(stdout);
+	for (i = 0; i < threads; i++) {
+		ret = locktest_spawn(tdata + i, thread + i, pid + i, i);
+		if (ret) {
+			/* Could not start worker; abort */
+			futex_barrier_abort(&shared->barrier, -1,
+					    harness_flags);
+			if (ret > 0)
+				i++;	/* started, but not as requested */
 			while (--i >= 0)
-				pthread_join(thread[i], NULL);
+				locktest_join(thread[i], pid[i]);
+			munmap(shared, size);
 			print_result(RET_ERROR);
 			return RET_ERROR;
 		}
-	barrier_wait(&shared.barrier_before);
-	before = times(&tms_before);
-	barrier_unblock(&shared.barrier_before, 1);
-	barrier_wait(&shared.barrier_after);
-	after = times(&tms_after);
-	wall = after - before;
-	user = tms_after.tms_utime - tms_before.tms_utime;
-	system = tms_after.tms_stime - tms_before.tms_stime;
-	tick = 1.0 / sysconf(_SC_CLK_TCK);
-	info("%.2fs user, %.2fs system, %.2fs wall, %.2f cores\n",
-	     user * tick, system * tick, wall * tick,
-	     wall ? (user + system) * 1. / wall : 1.);
-	barrier_unblock(&shared.barrier_after, 1);
+	}
+	futex_barrier_wait(&shared->barrier, harness_flags);
+	if (locktest_warmup) {
+		futex_barrier_release(&shared->barrier, 1, harness_flags);
+		harness_sleep(locktest_warmup);
+		shared->stop = 1;
+		futex_barrier_wait(&shared->barrier, harness_flags);
+		shared->stop = shared->failed;
+	}
+	harness_rusage(RUSAGE_SELF, &user0, &system0);
+	before = harness_now();
+	futex_barrier_release(&shared->barrier, 1, harness_flags);
+	if (locktest_duration) {
+		harness_sleep(locktest_duration);
+		shared->stop = 1;
+	}
+	futex_barrier_wait(&shared->barrier, harness_flags);
+	after = harness_now();
+	hist_init(&acquire);
+	hist_init(&release);
+	for (i = 0; i < threads; i++) {
+		hist_merge(&acquire, &tdata[i].acquire);
+		hist_merge(&release, &tdata[i].release);
+		total += tdata[i].iterations;
+		syscalls += tdata[i].syscalls;
+	}
+	futex_barrier_release(&shared->barrier, 1, harness_flags);
 	for (i = 0; i < threads; i++)
-		pthread_join(thread[i], NULL);
+		locktest_join(thread[i], pid[i]);
+	if (shared->failed) {
+		munmap(shared, size);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+
+	harness_rusage(RUSAGE_SELF, &user, &system);
+	user -= user0;
+	system -= system0;
+	for (i = 0; i < threads; i++) {
+		user += tdata[i].user;
+		system += tdata[i].system;
+	}
+	info("%.2fs user, %.2fs system, %.2fs wall, %.2f cores\n",
+	     user / 1e9, system / 1e9, (after - before) / 1e9,
+	     (double)(user + system) / (after - before));
+
+	locktest_record_args(iterations, threads);
+	record_num("throughput", total * 1e6 / (after - before));
+	record_str("unit", "Kiter/s");
+	record_num("user_s", user / 1e9);
+	record_num("system_s", system / 1e9);
+	record_num("wall_s", (after - before) / 1e9);
+	record_hist("acquire", &acquire, locktest_tick_ns);
+	record_hist("release", &release, locktest_tick_ns);
+	record_num("syscalls_per_op", total ? (double)syscalls / total : 0);
 
-	printf("Result: %.0f Kiter/s\n",
-	       (threads * shared.loops) / (wall * tick * 1000));
+	hist_print_scaled("Acquire", &acquire, locktest_tick_ns);
+	hist_print_scaled("Release", &release, locktest_tick_ns);
+	printf("\tSyscalls: %.3f per acquisition\n",
+	       total ? (double)syscalls / total : 0.);
+	locktest_fairness(tdata, threads);
+	printf("Result: %.0f Kiter/s\n", total * 1e6 / (after - before));
+	record_end();
+	munmap(shared, size);
 
 	return RET_PASS;
 }
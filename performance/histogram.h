@@ -0,0 +1,174 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      histogram.h
+ *
+ * DESCRIPTION
+ *      Fixed size log-linear latency histograms for the performance tests.
+ *      Each power of two range is split into HIST_SUB linear sub-buckets,
+ *      bounding the relative error of any reported value to 1/HIST_SUB.
+ *      Histograms are plain structures with no dynamic allocation so they
+ *      can be preallocated per thread and updated from the timed loop.
+ *
+ *****************************************************************************/
+
+#ifndef _HISTOGRAM_H
+#define _HISTOGRAM_H
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+
+#define HIST_SUB_BITS	4
+#define HIST_SUB	(1 << HIST_SUB_BITS)
+#define HIST_BUCKETS	((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+struct histogram {
+	u_int64_t count;
+	u_int64_t max;
+	u_int64_t bucket[HIST_BUCKETS];
+};
+
+/**
+ * hist_init() - reset a histogram to empty
+ * @hist:	the histogram to reset
+ */
+static inline void hist_init(struct histogram *hist)
+{
+	memset(hist, 0, sizeof(*hist));
+}
+
+/**
+ * hist_index() - map a value to its bucket index
+ * @val:	the value to be recorded
+ *
+ * Values below HIST_SUB map one to one, larger values keep their
+ * HIST_SUB_BITS most significant bits below the leading one.
+ */
+static inline int hist_index(u_int64_t val)
+{
+	int msb;
+
+	if (val < HIST_SUB)
+		return val;
+	msb = 63 - __builtin_clzll(val);
+	return (msb - HIST_SUB_BITS + 1) * HIST_SUB +
+	       (int)((val >> (msb - HIST_SUB_BITS)) - HIST_SUB);
+}
+
+/**
+ * hist_value() - return the highest value mapped to a bucket
+ * @index:	the bucket index
+ */
+static inline u_int64_t hist_value(int index)
+{
+	int shift;
+	u_int64_t mant;
+
+	if (index < HIST_SUB)
+		return index;
+	shift = index / HIST_SUB - 1;
+	mant = index % HIST_SUB + HIST_SUB;
+	return ((mant + 1) << shift) - 1;
+}
+
+/**
+ * hist_add() - record one value
+ * @hist:	the histogram to update
+ * @val:	the value to record
+ */
+static inline void hist_add(struct histogram *hist, u_int64_t val)
+{
+	hist->bucket[hist_index(val)]++;
+	hist->count++;
+	if (val > hist->max)
+		hist->max = val;
+}
+
+/**
+ * hist_merge() - accumulate one histogram into another
+ * @dst:	the histogram to update
+ * @src:	the histogram to be added to dst
+ */
+static inline void hist_merge(struct histogram *dst, struct histogram *src)
+{
+	int i;
+
+	for (i = 0; i < HIST_BUCKETS; i++)
+		dst->bucket[i] += src->bucket[i];
+	dst->count += src->count;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+/**
+ * hist_percentile() - return the value at or below which pct% of samples fall
+ * @hist:	the histogram to query
+ * @pct:	the percentile, 0 < pct <= 100
+ *
+ * The result is the upper bound of the bucket holding the requested sample,
+ * clamped to the largest recorded value.
+ */
+static inline u_int64_t hist_percentile(struct histogram *hist, double pct)
+{
+	u_int64_t target, seen = 0;
+	int i;
+
+	if (!hist->count)
+		return 0;
+	target = (u_int64_t)(hist->count * pct / 100.0 + 0.5);
+	if (target < 1)
+		target = 1;
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += hist->bucket[i];
+		if (seen >= target)
+			break;
+	}
+	if (i == HIST_BUCKETS || hist_value(i) > hist->max)
+		return hist->max;
+	return hist_value(i);
+}
+
+/**
+ * hist_print_scaled() - print the standard percentile summary of a histogram
+ * @name:	label for the line, e.g. "Acquire"
+ * @hist:	the histogram to summarize
+ * @scale:	nanoseconds per recorded unit
+ */
+static inline void hist_print_scaled(const char *name, struct histogram *hist,
+				     double scale)
+{
+	printf("\t%s: p50=%.0fns p90=%.0fns p99=%.0fns p99.9=%.0fns "
+	       "max=%.0fns\n", name,
+	       hist_percentile(hist, 50) * scale,
+	       hist_percentile(hist, 90) * scale,
+	       hist_percentile(hist, 99) * scale,
+	       hist_percentile(hist, 99.9) * scale,
+	       hist->max * scale);
+}
+
+/**
+ * hist_print() - print the percentile summary of a histogram in nanoseconds
+ * @name:	label for the line, e.g. "Acquire"
+ * @hist:	the histogram to summarize
+ */
+static inline void hist_print(const char *name, struct histogram *hist)
+{
+	hist_print_scaled(name, hist, 1.0);
+}
+
+#endif
@@ -44,8 +44,185 @@ if [ "$USE_COLOR" -eq 1 ]; then
     COLOR="-c"
 fi
 
-for THREADS in 1 2 3 4 5 6 8 10 12 16 24 32 64 128 256 512 1024; do
-    ./futex_wait $COLOR -n $THREADS
+THREAD_COUNTS="1 2 3 4 5 6 8 10 12 16 24 32 64 128 256 512 1024"
+# Time bounded runs keep every thread count equally long
+LOCKTEST_ARGS="-w 1s -d 5s"
+
+# With FORMAT=json or FORMAT=csv the records of each locktest sweep are
+# collected in $RESULTS/<sweep>.$FORMAT, the usual output going to stderr.
+RESULTS=${RESULTS:-results}
+if [ -n "$FORMAT" ]; then
+    mkdir -p $RESULTS
+    for SWEEP in futex_wait futex_wait_shared futex_lock_pi futex_mutex futex_adaptive futex_mcs futex_word; do
+        : > $RESULTS/$SWEEP.$FORMAT
+    done
+fi
+
+# run_locktest SWEEP TEST [ARGS...]
+run_locktest() {
+    SWEEP=$1
+    shift
+    if [ -z "$FORMAT" ]; then
+        "$@"
+        return
+    fi
+    "$@" -o $FORMAT >> $RESULTS/$SWEEP.$FORMAT
+}
+
+for THREADS in $THREAD_COUNTS; do
+    run_locktest futex_wait ./futex_wait $COLOR $LOCKTEST_ARGS -n $THREADS
+    run_locktest futex_wait_shared \
+        ./futex_wait $COLOR $LOCKTEST_ARGS -n $THREADS -f
+    run_locktest futex_lock_pi \
+        ./futex_lock_pi $COLOR $LOCKTEST_ARGS -n $THREADS
+done
+
+# Compare the futex_mutex.h mutexes on the same harness
+for MUTEX in cmpxchg drepper1 drepper2 drepper3 ticket; do
+    for THREADS in 2 8 64 256; do
+        run_locktest futex_mutex \
+            ./futex_wait $COLOR $LOCKTEST_ARGS -n $THREADS -m $MUTEX
+    done
+done
+
+# Sweep the spin budget of the adaptive mutex, ending with self tuning
+for SPINS in 0 16 64 256 1024 4096 16384 auto; do
+    for THREADS in 2 8 64; do
+        run_locktest futex_adaptive ./futex_wait $COLOR $LOCKTEST_ARGS \
+            -n $THREADS -m adaptive -b $SPINS -s 100
+    done
+done
+
+# The MCS queue lock against the default lock under heavy contention
+for THREADS in 64 128 256 512 1024; do
+    for MUTEX in cmpxchg mcs; do
+        run_locktest futex_mcs \
+            ./futex_wait $COLOR $LOCKTEST_ARGS -n $THREADS -m $MUTEX
+    done
+done
+
+# The futex2 word sizes the kernel implements, probed once with a one
+# iteration run so the sweeps below skip the others
+WORDS=""
+for WORD in u8 u16 u32 u64; do
+    if ./futex_wait -n 1 -i 1 -z $WORD > /dev/null 2>&1; then
+        WORDS="$WORDS $WORD"
+    else
+        echo "futex2 $WORD word: not supported by the kernel, skipped"
+    fi
+done
+
+# The futex2 word sizes against the futex() syscall
+for THREADS in 2 8 64 256; do
+    run_locktest futex_word ./futex_wait $COLOR $LOCKTEST_ARGS -n $THREADS
+    for WORD in $WORDS; do
+        run_locktest futex_word \
+            ./futex_wait $COLOR $LOCKTEST_ARGS -n $THREADS -z $WORD
+    done
+done
+
+# Every csv record repeats the header line, keep only the first
+if [ "$FORMAT" = "csv" ]; then
+    for SWEEP in futex_wait futex_wait_shared futex_lock_pi futex_mutex futex_adaptive futex_mcs futex_word; do
+        awk 'NR == 1 { h = $0 } NR == 1 || $0 != h' \
+            $RESULTS/$SWEEP.csv > $RESULTS/$SWEEP.tmp &&
+            mv $RESULTS/$SWEEP.tmp $RESULTS/$SWEEP.csv
+    done
+fi
+
+# With BASELINE=<file> the futex_wait sweep is repeated REPEAT times per thread
+# count and checked against the baseline, or saved as one, see compare.sh
+if [ -n "$BASELINE" ]; then
+    echo
+    LOCKTEST_ARGS="$LOCKTEST_ARGS" \
+        ./compare.sh -r ${REPEAT:-5} -n "$THREAD_COUNTS" -b $BASELINE
+fi
+
+echo
+for READ in 99 90 50; do
+    for THREADS in 4 16 64; do
+        ./futex_rwlock $COLOR -n $THREADS -r $READ
+        ./futex_rwlock $COLOR -n $THREADS -r $READ -t
+    done
+done
+
+echo
+for RATIO in "1 16" "4 4" "16 1"; do
+    set -- $RATIO
+    for WAKE in "" -b; do
+        ./futex_cond $COLOR -p $1 -n $2 $WAKE
+        ./futex_cond $COLOR -p $1 -n $2 $WAKE -g
+    done
+done
+
+echo
+for RATIO in "1 1" "1 8" "8 1" "8 8" "64 64"; do
+    set -- $RATIO
+    ./futex_queue $COLOR -p $1 -n $2
+done
+
+echo
+for THREADS in 4 64 256 1024; do
+    for BARRIER in tree linear pthread; do
+        ./futex_barrier $COLOR -n $THREADS -m $BARRIER
+    done
+done
+
+echo
+for THREADS in 1 4 16 64 256; do
+    ./futex_wake_op $COLOR -n $THREADS
+    ./futex_wake_op $COLOR -n $THREADS -s
+done
+
+echo
+for THREADS in $THREAD_COUNTS; do
+    ./futex_wake $COLOR -n $THREADS
+done
+
+echo
+for THREADS in 16 256; do
+    for WORD in $WORDS; do
+        ./futex_wake $COLOR -n $THREADS -z $WORD
+    done
+done
+
+echo
+for THREADS in 16 64 256 1024; do
+    for CLASSES in 1 4 16; do
+        ./futex_bitset $COLOR -n $THREADS -b $CLASSES
+        ./futex_bitset $COLOR -n $THREADS -b $CLASSES -p
+    done
+done
+
+echo
+for SOURCES in 2 4 8 16 32 64 128; do
+    for MODE in waitv bitset thread; do
+        ./futex_waitv $COLOR -n $SOURCES -m $MODE
+    done
+done
+
+echo
+# Stride, largest futex count and alignment. Fewer futexes at the page
+# stride, 64k of them would take 256 MiB. The line and page strides also run
+# with the words moved off the line and page boundaries.
+for LAYOUT in "4 65536 0" "64 65536 0" "64 65536 60" "4096 4096 0" \
+              "4096 4096 2052"; do
+    set -- $LAYOUT
+    ./futex_hash $COLOR -s $1 -k $2 -a $3
+done
+
+echo
+for WAITERS in 2 4 8 16 32 64 128 256 512 1024 2048 4096; do
+    ./futex_requeue $COLOR -n $WAITERS
+    ./futex_requeue $COLOR -n $WAITERS -w
+done
+
+echo
+for WAITERS in 1 2 4 8 16 32 64 128; do
+    ./futex_requeue_pi $COLOR -n $WAITERS
+    ./futex_requeue_pi $COLOR -n $WAITERS -r
+    ./futex_requeue_pi $COLOR -n $WAITERS -b
+    ./futex_requeue_pi $COLOR -n $WAITERS -b -r
 done
 
 exit 0
@@ -0,0 +1,221 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      topology.h
+ *
+ * DESCRIPTION
+ *      CPU topology discovery from sysfs and worker placement policies for
+ *      the performance tests. A placement is an ordered list of CPUs, worker
+ *      i being bound to entry i modulo the list length:
+ *      o compact: fill the SMT siblings of a core, then the cores of a
+ *        package, then the next package or NUMA node
+ *      o scatter: one CPU per core, alternating across packages and NUMA
+ *        nodes, before using the second SMT sibling of any core
+ *      o an explicit cpu list, e.g. "0,2,8-11"
+ *
+ *****************************************************************************/
+
+#ifndef _TOPOLOGY_H
+#define _TOPOLOGY_H
+
+#include <dirent.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct cpu_topo {
+	int cpu;
+	int node;
+	int package;
+	int core;
+	int smt;	/* index of this cpu among its core's siblings */
+	int core_rank;	/* index of this core within its package */
+};
+
+static inline int sysfs_cpu_int(int cpu, const char *file, int fallback)
+{
+	char path[128];
+	FILE *f;
+	int val;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/%s",
+		 cpu, file);
+	if (!(f = fopen(path, "r")))
+		return fallback;
+	if (fscanf(f, "%d", &val) != 1)
+		val = fallback;
+	fclose(f);
+	return val;
+}
+
+static inline int sysfs_cpu_node(int cpu)
+{
+	char path[64];
+	struct dirent *de;
+	DIR *dir;
+	int node = 0;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+	if (!(dir = opendir(path)))
+		return 0;
+	while ((de = readdir(dir)))
+		if (sscanf(de->d_name, "node%d", &node) == 1)
+			break;
+	closedir(dir);
+	return node;
+}
+
+/**
+ * topology_read() - describe every cpu the process may run on
+ * @topo:	array of at least CPU_SETSIZE entries to fill in
+ *
+ * Missing sysfs entries are treated as one core per cpu in a single
+ * package and node. Return the number of cpus found.
+ */
+static inline int topology_read(struct cpu_topo *topo)
+{
+	cpu_set_t allowed;
+	int i, j, n = 0;
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed))
+		return 0;
+	for (i = 0; i < CPU_SETSIZE; i++) {
+		if (!CPU_ISSET(i, &allowed))
+			continue;
+		topo[n].cpu = i;
+		topo[n].node = sysfs_cpu_node(i);
+		topo[n].package = sysfs_cpu_int(i,
+				"topology/physical_package_id", 0);
+		topo[n].core = sysfs_cpu_int(i, "topology/core_id", i);
+		n++;
+	}
+
+	/* topo[] is in cpu order, so siblings are ranked by cpu number */
+	for (i = 0; i < n; i++) {
+		topo[i].smt = 0;
+		for (j = 0; j < i; j++)
+			if (topo[j].package == topo[i].package &&
+			    topo[j].core == topo[i].core)
+				topo[i].smt++;
+	}
+	for (i = 0; i < n; i++) {
+		topo[i].core_rank = 0;
+		for (j = 0; j < n; j++)
+			if (topo[j].package == topo[i].package &&
+			    topo[j].core < topo[i].core && topo[j].smt == 0)
+				topo[i].core_rank++;
+	}
+	return n;
+}
+
+static inline int topo_cmp_compact(const void *a, const void *b)
+{
+	const struct cpu_topo *x = a, *y = b;
+
+	if (x->node != y->node)
+		return x->node - y->node;
+	if (x->package != y->package)
+		return x->package - y->package;
+	if (x->core != y->core)
+		return x->core - y->core;
+	return x->cpu - y->cpu;
+}
+
+static inline int topo_cmp_scatter(const void *a, const void *b)
+{
+	const struct cpu_topo *x = a, *y = b;
+
+	if (x->smt != y->smt)
+		return x->smt - y->smt;
+	if (x->core_rank != y->core_rank)
+		return x->core_rank - y->core_rank;
+	if (x->node != y->node)
+		return x->node - y->node;
+	if (x->package != y->package)
+		return x->package - y->package;
+	return x->cpu - y->cpu;
+}
+
+/* Parse a cpu list such as "0,2,8-11", return the number of entries */
+static inline int cpu_list_parse(const char *list, int *map)
+{
+	const char *p = list;
+	char *end;
+	long first, last;
+	int n = 0;
+
+	while (*p) {
+		first = strtol(p, &end, 10);
+		if (end == p || first < 0 || first >= CPU_SETSIZE)
+			return -1;
+		last = first;
+		p = end;
+		if (*p == '-') {
+			last = strtol(p + 1, &end, 10);
+			if (end == p + 1 || last < first ||
+			    last >= CPU_SETSIZE)
+				return -1;
+			p = end;
+		}
+		while (first <= last && n < CPU_SETSIZE)
+			map[n++] = first++;
+		if (*p == ',')
+			p++;
+		else if (*p)
+			return -1;
+	}
+	return n ? n : -1;
+}
+
+/**
+ * cpu_map_build() - order cpus according to a placement policy
+ * @policy:	"compact", "scatter" or a cpu list
+ * @map:	array of at least CPU_SETSIZE entries to fill in
+ *
+ * Return the number of entries in map, or -1 if the policy is invalid.
+ */
+static inline int cpu_map_build(const char *policy, int *map)
+{
+	struct cpu_topo *topo;
+	int i, n;
+
+	if (strcmp(policy, "compact") && strcmp(policy, "scatter"))
+		return cpu_list_parse(policy, map);
+
+	topo = calloc(CPU_SETSIZE, sizeof(*topo));
+	if (!topo)
+		return -1;
+	n = topology_read(topo);
+	qsort(topo, n, sizeof(*topo), strcmp(policy, "compact") ?
+	      topo_cmp_scatter : topo_cmp_compact);
+	for (i = 0; i < n; i++)
+		map[i] = topo[i].cpu;
+	free(topo);
+	return n ? n : -1;
+}
+
+/* Print a cpu map as a comma separated list */
+static inline void cpu_map_print(int *map, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		printf("%s%d", i ? "," : "", map[i]);
+}
+
+#endif
@@ -0,0 +1,256 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      futex_contend.c
+ *
+ * DESCRIPTION
+ *      Thousands of threads contending on a single futex for a fixed time.
+ *      Each thread repeatedly takes a mutex built on the futex, increments a
+ *      shared counter and releases it, using either FUTEX_WAIT/FUTEX_WAKE
+ *      (-m wait) or FUTEX_LOCK_PI/FUTEX_UNLOCK_PI (-m pi). Progress is
+ *      printed every interval; a watchdog declares a hang, or a lost wakeup
+ *      when the futex is unlocked while threads are still waiting, if no
+ *      thread gets through for the watchdog period. At the end the counter
+ *      must match the sum of the per thread operation counts.
+ *
+ *****************************************************************************/
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "futextest.h"
+#include "futex_mutex.h"
+#include "logging.h"
+#include "stress.h"
+
+#define MODE_WAIT	0
+#define MODE_PI		1
+
+static int threads = 4096;
+static int mode = MODE_WAIT;
+
+static futex_t futex;
+static futex_t start;
+static volatile int stop;
+static atomic_t exited = ATOMIC_INITIALIZER;
+static atomic_t failures = ATOMIC_INITIALIZER;
+static long counter;
+
+static __thread pid_t tid;
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -c	Use color\n");
+	printf("  -h	Display this help message\n");
+	printf("  -m M	Futex operations: wait (FUTEX_WAIT/WAKE) or pi "
+	       "(FUTEX_LOCK_PI/UNLOCK_PI) (default: wait)\n");
+	printf("  -n N	Number of threads (default: %d)\n", threads);
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+	stress_usage();
+}
+
+static inline void mutex_lock(struct stress_worker *self)
+{
+	if (futex_mutex_trylock(&futex))
+		return;
+	self->waiting = 1;
+	futex_mutex2_lock(&futex, FUTEX_PRIVATE_FLAG);
+	self->waiting = 0;
+}
+
+static inline void mutex_unlock(void)
+{
+	futex_mutex2_unlock(&futex, FUTEX_PRIVATE_FLAG);
+}
+
+/* A failed PI operation ends the run, the test then reports ERROR */
+static void pi_failed(const char *op)
+{
+	error("%s\n", errno, op);
+	atomic_inc(&failures);
+	stop = 1;
+}
+
+static inline int pi_lock(struct stress_worker *self)
+{
+	int ret;
+
+	if (futex_cmpxchg(&futex, 0, tid) == 0)
+		return 0;
+	self->waiting = 1;
+	ret = futex_pi_lock(&futex, tid, FUTEX_PRIVATE_FLAG);
+	self->waiting = 0;
+	if (ret)
+		pi_failed("futex_lock_pi");
+	return ret;
+}
+
+static inline int pi_unlock(void)
+{
+	int ret = futex_pi_unlock(&futex, tid, FUTEX_PRIVATE_FLAG);
+
+	if (ret)
+		pi_failed("futex_unlock_pi");
+	return ret;
+}
+
+static void *contend_thread(void *arg)
+{
+	struct stress_worker *self = arg;
+	u_int64_t before, stall;
+
+	tid = syscall(SYS_gettid);
+	while (!start)
+		futex_wait(&start, 0, NULL, FUTEX_PRIVATE_FLAG);
+
+	while (!stop) {
+		before = stress_now();
+		if (mode == MODE_PI) {
+			if (pi_lock(self))
+				break;
+		} else {
+			mutex_lock(self);
+		}
+		stall = stress_now() - before;
+		if (stall > self->max_stall)
+			self->max_stall = stall;
+		counter++;
+		self->ops++;
+		if (mode == MODE_PI) {
+			if (pi_unlock())
+				break;
+		} else {
+			mutex_unlock();
+		}
+	}
+	atomic_inc(&exited);
+	return NULL;
+}
+
+static void progress(void)
+{
+	info("futex=0x%x counter=%ld\n", futex, counter);
+}
+
+int main(int argc, char *argv[])
+{
+	struct stress_worker *worker;
+	struct stress_stats stats;
+	pthread_t *thread;
+	int started, ret, c;
+
+	while ((c = getopt(argc, argv, "chm:n:v:" STRESS_GETOPT)) != -1) {
+		switch(c) {
+		case 'c':
+			log_color(1);
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'm':
+			if (!strcmp(optarg, "wait"))
+				mode = MODE_WAIT;
+			else if (!strcmp(optarg, "pi"))
+				mode = MODE_PI;
+			else {
+				usage(basename(argv[0]));
+				exit(1);
+			}
+			break;
+		case 'n':
+			threads = atoi(optarg);
+			break;
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			if (stress_getopt(c, optarg))
+				break;
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	printf("%s: Contend on a single futex with %s\n", basename(argv[0]),
+	       mode == MODE_PI ? "FUTEX_LOCK_PI" : "FUTEX_WAIT/FUTEX_WAKE");
+	printf("\tArguments: threads=%d duration=%ds interval=%ds "
+	       "watchdog=%ds\n", threads, stress_duration, stress_interval,
+	       stress_watchdog);
+
+	worker = calloc(threads, sizeof(*worker));
+	thread = calloc(threads, sizeof(*thread));
+	if (!worker || !thread) {
+		error("calloc\n", errno);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+
+	started = stress_spawn(thread, worker, threads, contend_thread);
+	if (started < threads) {
+		/* Could not create all threads; abort */
+		stop = 1;
+		start = 1;
+		futex_wake(&start, INT_MAX, FUTEX_PRIVATE_FLAG);
+		stress_drain(thread, started, &exited);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+	start = 1;
+	futex_wake(&start, INT_MAX, FUTEX_PRIVATE_FLAG);
+
+	ret = stress_monitor(worker, threads, &stop, &stats, progress);
+	if (ret == 0 && stress_drain(thread, threads, &exited))
+		ret = -1;
+	stress_sum(worker, threads, &stats);
+	if (failures.val) {
+		error("%d PI lock operations failed\n", 0, failures.val);
+		/* Waiters on the broken lock go away with the process */
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+	if (ret) {
+		if (futex == 0 && stats.waiting)
+			error("lost wakeup: futex unlocked with %ld threads "
+			      "waiting\n", 0, stats.waiting);
+		else
+			error("hang: futex=0x%x with %ld threads waiting\n", 0,
+			      futex, stats.waiting);
+		/* The stuck threads go away with the process */
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+	free(thread);
+	free(worker);
+
+	if (counter != stats.ops) {
+		error("counter=%ld does not match %ld operations\n", 0,
+		      counter, stats.ops);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+
+	printf("\tThroughput: %.0f ops/s\n", stats.ops * 1e9 / stats.elapsed);
+	printf("\tWorst stall: %.0fus, longest without progress: %.0fus\n",
+	       stats.max_stall / 1e3, stats.max_idle / 1e3);
+	printf("Result: COMPLETED\n");
+
+	return RET_PASS;
+}
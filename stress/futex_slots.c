@@ -0,0 +1,271 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      futex_slots.c
+ *
+ * DESCRIPTION
+ *      Thousands of threads on thousands of futexes. A large array of slots,
+ *      each a counter protected by its own futex mutex, is hammered by
+ *      threads picking slots at random; with -l a share of the picks stays
+ *      close to the previous slot. The futexes are private, or shared on a
+ *      MAP_SHARED mapping (-s), which hash differently in the kernel. The
+ *      throughput of every interval is printed so any degradation as the
+ *      kernel futex hash fills up is visible. At the end each slot's locked
+ *      counter must match an atomic count of the updates made to it.
+ *
+ *****************************************************************************/
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "futextest.h"
+#include "futex_mutex.h"
+#include "logging.h"
+#include "stress.h"
+
+struct slot {
+	futex_t lock;
+	long count;	/* updated under lock */
+	long check;	/* updated atomically after unlock */
+};
+
+static int threads = 4096;
+static int slots = 65536;
+static int slot_size = 64;
+static int locality = 0;
+static int window = 64;
+static int shared = 0;
+
+static int flags = FUTEX_PRIVATE_FLAG;
+static char *base;
+static futex_t start;
+static volatile int stop;
+static atomic_t exited = ATOMIC_INITIALIZER;
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -c	Use color\n");
+	printf("  -h	Display this help message\n");
+	printf("  -k K	Number of slots (default: %d)\n", slots);
+	printf("  -l L	Percentage of picks within the window around the "
+	       "previous slot (default: %d)\n", locality);
+	printf("  -n N	Number of threads (default: %d)\n", threads);
+	printf("  -s	Use shared futexes on a MAP_SHARED mapping\n");
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+	printf("  -w W	Slots on either side of the previous slot for -l "
+	       "(default: %d)\n", window);
+	printf("  -z Z	Bytes per slot, sets the memory footprint "
+	       "(default: %d)\n", slot_size);
+	stress_usage();
+}
+
+static inline struct slot *slot_at(long idx)
+{
+	return (struct slot *)(base + idx * slot_size);
+}
+
+static inline void mutex_lock(futex_t *futex, struct stress_worker *self)
+{
+	if (futex_mutex_trylock(futex))
+		return;
+	self->waiting = 1;
+	futex_mutex2_lock(futex, flags);
+	self->waiting = 0;
+}
+
+static inline void mutex_unlock(futex_t *futex)
+{
+	futex_mutex2_unlock(futex, flags);
+}
+
+static void *slots_thread(void *arg)
+{
+	struct stress_worker *self = arg;
+	u_int32_t seed = self->id * 2654435761u + 1;
+	u_int64_t before, stall;
+	struct slot *slot;
+	long idx;
+
+	while (!start)
+		futex_wait(&start, 0, NULL, FUTEX_PRIVATE_FLAG);
+
+	idx = stress_rand(&seed) % slots;
+	while (!stop) {
+		if (locality && stress_rand(&seed) % 100 < locality)
+			idx = (idx + slots - window +
+			       stress_rand(&seed) % (2 * window + 1)) % slots;
+		else
+			idx = stress_rand(&seed) % slots;
+		slot = slot_at(idx);
+
+		before = stress_now();
+		mutex_lock(&slot->lock, self);
+		stall = stress_now() - before;
+		if (stall > self->max_stall)
+			self->max_stall = stall;
+		slot->count++;
+		mutex_unlock(&slot->lock);
+		__sync_fetch_and_add(&slot->check, 1);
+		self->ops++;
+	}
+	atomic_inc(&exited);
+	return NULL;
+}
+
+/* Report how many slots currently have waiters queued in the kernel */
+static void progress(void)
+{
+	long i, contended = 0;
+
+	for (i = 0; i < slots; i++)
+		if (slot_at(i)->lock == 2)
+			contended++;
+	info("%ld slots with waiters\n", contended);
+}
+
+int main(int argc, char *argv[])
+{
+	struct stress_worker *worker;
+	struct stress_stats stats;
+	pthread_t *thread;
+	long i, total = 0, bad = 0;
+	size_t size;
+	int started, ret, c;
+
+	while ((c = getopt(argc, argv, "chk:l:n:sv:w:z:" STRESS_GETOPT)) != -1) {
+		switch(c) {
+		case 'c':
+			log_color(1);
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'k':
+			slots = atoi(optarg);
+			break;
+		case 'l':
+			locality = atoi(optarg);
+			break;
+		case 'n':
+			threads = atoi(optarg);
+			break;
+		case 's':
+			shared = 1;
+			flags = 0;
+			break;
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		case 'w':
+			window = atoi(optarg);
+			break;
+		case 'z':
+			slot_size = atoi(optarg);
+			break;
+		default:
+			if (stress_getopt(c, optarg))
+				break;
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	size = (size_t)slots * slot_size;
+	printf("%s: Contend on %d %s futexes\n", basename(argv[0]), slots,
+	       shared ? "shared" : "private");
+	printf("\tArguments: threads=%d slots=%d slot_size=%dB footprint=%zuKB "
+	       "locality=%d%% window=%d duration=%ds interval=%ds "
+	       "watchdog=%ds\n", threads, slots, slot_size, size / 1024,
+	       locality, window, stress_duration, stress_interval,
+	       stress_watchdog);
+
+	if (slots < 1 || slot_size < (int)sizeof(struct slot) ||
+	    slot_size % (int)sizeof(long) || locality < 0 || locality > 100 ||
+	    window < 0 || window >= slots) {
+		error("slot_size must be a multiple of %zu and at least %zu, "
+		      "window below the number of slots\n", 0, sizeof(long),
+		      sizeof(struct slot));
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+
+	base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		    (shared ? MAP_SHARED : MAP_PRIVATE) | MAP_ANONYMOUS, -1, 0);
+	worker = calloc(threads, sizeof(*worker));
+	thread = calloc(threads, sizeof(*thread));
+	if (base == MAP_FAILED || !worker || !thread) {
+		error("allocating slots and threads\n", errno);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+
+	started = stress_spawn(thread, worker, threads, slots_thread);
+	if (started < threads) {
+		/* Could not create all threads; abort */
+		stop = 1;
+		start = 1;
+		futex_wake(&start, INT_MAX, FUTEX_PRIVATE_FLAG);
+		stress_drain(thread, started, &exited);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+	start = 1;
+	futex_wake(&start, INT_MAX, FUTEX_PRIVATE_FLAG);
+
+	ret = stress_monitor(worker, threads, &stop, &stats, progress);
+	if (ret == 0 && stress_drain(thread, threads, &exited))
+		ret = -1;
+	stress_sum(worker, threads, &stats);
+	if (ret) {
+		error("hang: no progress for %ds with %ld threads waiting\n", 0,
+		      stress_watchdog, stats.waiting);
+		/* The stuck threads go away with the process */
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+	free(thread);
+	free(worker);
+
+	for (i = 0; i < slots; i++) {
+		if (slot_at(i)->count != slot_at(i)->check) {
+			if (!bad++)
+				error("slot %ld: count=%ld but %ld updates\n",
+				      0, i, slot_at(i)->count,
+				      slot_at(i)->check);
+		}
+		total += slot_at(i)->count;
+	}
+	munmap(base, size);
+	if (bad || total != stats.ops) {
+		error("%ld slots lost updates, %ld counted for %ld "
+		      "operations\n", 0, bad, total, stats.ops);
+		print_result(RET_ERROR);
+		return RET_ERROR;
+	}
+
+	printf("\tThroughput: %.0f ops/s\n", stats.ops * 1e9 / stats.elapsed);
+	printf("\tWorst stall: %.0fus, longest without progress: %.0fus\n",
+	       stats.max_stall / 1e3, stats.max_idle / 1e3);
+	printf("Result: COMPLETED\n");
+
+	return RET_PASS;
+}
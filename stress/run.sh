@@ -44,4 +44,18 @@ if [ "$USE_COLOR" -eq 1 ]; then
     COLOR="-c"
 fi
 
+for MODE in wait pi; do
+    for THREADS in 1024 10240; do
+        ./futex_contend $COLOR -m $MODE -n $THREADS
+    done
+done
+
+echo
+for SHARED in "" -s; do
+    for SLOTS in 1024 65536 1048576; do
+        ./futex_slots $COLOR $SHARED -n 4096 -k $SLOTS
+        ./futex_slots $COLOR $SHARED -n 4096 -k $SLOTS -l 90
+    done
+done
+
 exit 0
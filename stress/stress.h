@@ -0,0 +1,241 @@
+/******************************************************************************
+ *
+ *   This program is free software;  you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY;  without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program;  if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * NAME
+ *      stress.h
+ *
+ * DESCRIPTION
+ *      Common routines for the stress tests: spawning thousands of workers
+ *      with small stacks, and a monitor which prints live progress while the
+ *      workers run for a fixed time and declares a hang when no worker makes
+ *      progress for the watchdog period.
+ *
+ *****************************************************************************/
+
+#ifndef _STRESS_H
+#define _STRESS_H
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include "atomic.h"
+#include "logging.h"
+
+/* Stack size of each worker, the default 8MB does not scale to 10k threads */
+#define STRESS_STACK	(64 * 1024)
+
+/* Options common to all stress tests, see stress_getopt() */
+#define STRESS_GETOPT "d:p:W:"
+static int stress_duration = 30;
+static int stress_interval = 1;
+static int stress_watchdog = 10;
+
+/* Per worker counters, padded so the monitor does not bounce their owners */
+struct stress_worker {
+	volatile long ops;
+	volatile int waiting;	/* inside a blocking slow path */
+	int id;
+	u_int64_t max_stall;
+} __attribute__((aligned(64)));
+
+/* Totals gathered by stress_monitor() */
+struct stress_stats {
+	long ops;
+	long waiting;
+	u_int64_t elapsed;
+	u_int64_t max_stall;
+	u_int64_t max_idle;	/* longest interval without any progress */
+};
+
+static inline u_int64_t stress_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* xorshift32, seeded per worker */
+static inline u_int32_t stress_rand(u_int32_t *state)
+{
+	u_int32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+/**
+ * stress_usage() - print the usage lines for the STRESS_GETOPT options
+ */
+static inline void stress_usage(void)
+{
+	printf("  -d D	Run for D seconds (default: %d)\n", stress_duration);
+	printf("  -p P	Print progress every P seconds (default: %d)\n",
+	       stress_interval);
+	printf("  -W W	Declare a hang after W seconds without progress "
+	       "(default: %d)\n", stress_watchdog);
+}
+
+/**
+ * stress_getopt() - parse one of the STRESS_GETOPT options
+ * @c:		the option character returned by getopt()
+ * @arg:	the option argument
+ *
+ * Return 1 if the option was consumed, 0 if it is not a valid stress option.
+ */
+static inline int stress_getopt(int c, char *arg)
+{
+	switch (c) {
+	case 'd':
+		stress_duration = atoi(arg);
+		return stress_duration > 0;
+	case 'p':
+		stress_interval = atoi(arg);
+		return stress_interval > 0;
+	case 'W':
+		stress_watchdog = atoi(arg);
+		return stress_watchdog > 0;
+	}
+	return 0;
+}
+
+/**
+ * stress_spawn() - start up to threads workers with small stacks
+ * @thread:	array of threads entries for the thread ids
+ * @worker:	array of threads entries passed to func
+ *
+ * Return the number of workers started, which is less than threads if the
+ * system ran out of threads or memory.
+ */
+static inline int stress_spawn(pthread_t *thread, struct stress_worker *worker,
+			       int threads, void *(*func)(void *))
+{
+	pthread_attr_t attr;
+	int i, ret;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, STRESS_STACK);
+	for (i = 0; i < threads; i++) {
+		worker[i].id = i;
+		ret = pthread_create(thread + i, &attr, func, worker + i);
+		if (ret) {
+			error("pthread_create: started %d of %d threads\n",
+			      ret, i, threads);
+			break;
+		}
+	}
+	pthread_attr_destroy(&attr);
+	return i;
+}
+
+static inline void stress_sum(struct stress_worker *worker, int threads,
+			      struct stress_stats *stats)
+{
+	int i;
+
+	stats->ops = 0;
+	stats->waiting = 0;
+	for (i = 0; i < threads; i++) {
+		stats->ops += worker[i].ops;
+		stats->waiting += worker[i].waiting;
+		if (worker[i].max_stall > stats->max_stall)
+			stats->max_stall = worker[i].max_stall;
+	}
+}
+
+/**
+ * stress_monitor() - run the workers for the duration and watch for hangs
+ * @stop:	set once the duration expired or a hang was detected, or by a
+ *		worker to end the run early
+ * @progress:	optional callback printing test specific progress
+ *
+ * Print the operation count and the rate over the last interval every
+ * interval, so throughput changes over the run are visible. Return 0 once the
+ * duration expired, or -1 if the operation count stalled for the watchdog
+ * period. stats holds the totals in either case.
+ */
+static inline int stress_monitor(struct stress_worker *worker, int threads,
+				 volatile int *stop, struct stress_stats *stats,
+				 void (*progress)(void))
+{
+	u_int64_t start, now, last, last_change;
+	long last_ops = 0;
+
+	memset(stats, 0, sizeof(*stats));
+	start = last = last_change = stress_now();
+	do {
+		sleep(stress_interval);
+		now = stress_now();
+		stress_sum(worker, threads, stats);
+		stats->elapsed = now - start;
+		printf("\t%5.0fs: ops=%ld ops/s=%.0f waiting=%ld\n",
+		       stats->elapsed / 1e9, stats->ops,
+		       (stats->ops - last_ops) * 1e9 / (now - last),
+		       stats->waiting);
+		last = now;
+		if (stats->ops != last_ops) {
+			last_change = now;
+			last_ops = stats->ops;
+		} else if (now - last_change > stats->max_idle) {
+			stats->max_idle = now - last_change;
+		}
+		if (progress)
+			progress();
+		fflush(stdout);
+		if (now - last_change >= stress_watchdog * 1000000000ULL) {
+			*stop = 1;
+			return -1;
+		}
+	} while (!*stop && stats->elapsed < stress_duration * 1000000000ULL);
+	*stop = 1;
+	return 0;
+}
+
+/**
+ * stress_drain() - join the workers once they have been told to stop
+ * @exited:	count of workers which have left their loop
+ *
+ * Return -1 without joining if the workers stop leaving for the watchdog
+ * period, 0 once all have been joined.
+ */
+static inline int stress_drain(pthread_t *thread, int threads,
+			       atomic_t *exited)
+{
+	int i, last = -1, idle = 0;
+
+	while (exited->val < threads) {
+		if (exited->val != last) {
+			last = exited->val;
+			idle = 0;
+		} else if (++idle > stress_watchdog * 10) {
+			return -1;
+		}
+		usleep(100000);
+	}
+	for (i = 0; i < threads; i++)
+		pthread_join(thread[i], NULL);
+	return 0;
+}
+
+#endif